@@ -0,0 +1,540 @@
+#include "batch.h"
+
+#include <parser/parallel.h>
+
+#include <parser/sink.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+/**
+ * @struct BatchFile
+ * @brief File to format in batch mode and where its output goes.
+ */
+struct BatchFile {
+    fs::path in_;
+    fs::path out_;
+    uintmax_t size_ = 0;
+    FileReport report_;
+    std::string diff_;
+};
+
+/**
+ * @brief Matches `path` against a glob where `*` stands for any run of
+ * characters but `/`, `**` for any run at all and `?` for any character but
+ * `/`.
+ */
+bool MatchGlob(std::string_view pattern, std::string_view path) {
+    if (pattern.empty()) {
+        return path.empty();
+    }
+    if (pattern.starts_with("**")) {
+        pattern.remove_prefix(2);
+        // "**/" also matches no directories at all.
+        if (pattern.starts_with('/') && MatchGlob(pattern.substr(1), path)) {
+            return true;
+        }
+        for (size_t i = 0; i <= path.size(); ++i) {
+            if (MatchGlob(pattern, path.substr(i))) {
+                return true;
+            }
+        }
+        return false;
+    }
+    if (pattern[0] == '*') {
+        for (size_t i = 0; i <= path.size(); ++i) {
+            if (MatchGlob(pattern.substr(1), path.substr(i))) {
+                return true;
+            }
+            if (i < path.size() && path[i] == '/') {
+                return false;
+            }
+        }
+        return false;
+    }
+    if (path.empty() || (pattern[0] == '?' && path[0] == '/') ||
+        (pattern[0] != '?' && pattern[0] != path[0])) {
+        return false;
+    }
+    return MatchGlob(pattern.substr(1), path.substr(1));
+}
+
+/**
+ * @brief Checks if `path`, relative to a searched directory, matches any of
+ * `patterns`. Patterns without a `/` are matched against the file name only.
+ */
+bool MatchAny(const std::vector<std::string>& patterns, const fs::path& path) {
+    std::string relative = path.generic_string();
+    std::string name = path.filename().generic_string();
+    return std::any_of(patterns.begin(), patterns.end(),
+                       [&relative, &name](const std::string& pattern) {
+                           bool has_slash =
+                               pattern.find('/') != std::string::npos;
+                           return MatchGlob(pattern,
+                                            has_slash ? relative : name);
+                       });
+}
+
+/**
+ * @brief Gets where the output of `in` goes: the same path under `output_dir`,
+ * with the root and leading `..` dropped.
+ */
+fs::path OutputPath(const fs::path& output_dir, const fs::path& in) {
+    fs::path out = output_dir;
+    bool leading = true;
+    for (const fs::path& part : in.lexically_normal().relative_path()) {
+        if (leading && part == "..") {
+            continue;
+        }
+        leading = false;
+        out /= part;
+    }
+    return out;
+}
+
+/**
+ * @brief Appends the files to format under `dir` to `files`, sorted by path.
+ */
+void CollectDirectory(const fs::path& dir, const Options& options,
+                      std::vector<fs::path>& files) {
+    std::vector<fs::path> found;
+    fs::recursive_directory_iterator it(
+        dir, fs::directory_options::skip_permission_denied);
+    for (; it != fs::recursive_directory_iterator(); ++it) {
+        fs::path relative = it->path().lexically_relative(dir);
+        if (MatchAny(options.excludes_, relative)) {
+            if (it->is_directory()) {
+                it.disable_recursion_pending();
+            }
+            continue;
+        }
+        if (it->is_regular_file() &&
+            (options.includes_.empty() ||
+             MatchAny(options.includes_, relative))) {
+            found.push_back(it->path());
+        }
+    }
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+}
+
+/**
+ * @struct ReadItem
+ * @brief File contents passed from the readers to the workers.
+ */
+struct ReadItem {
+    size_t file_;
+    Source source_;
+};
+
+/**
+ * @struct FormattedItem
+ * @brief Formatted output passed from the workers to the writers.
+ */
+struct FormattedItem {
+    size_t file_;
+    std::string text_;
+    // Where to cache the output, empty if it came from the cache.
+    std::string key_;
+    Source source_;
+};
+
+/**
+ * @struct StageStats
+ * @brief Thread count of a pipeline stage and the time its threads spent
+ * working rather than waiting on the queues, in total.
+ */
+struct StageStats {
+    const char* name_;
+    size_t threads_;
+    std::atomic<std::chrono::nanoseconds::rep> busy_ = 0;
+
+    template <class F>
+    void Time(F work) {
+        auto start = std::chrono::steady_clock::now();
+        work();
+        busy_ += (std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+// Bigger files are mapped rather than read upfront, so that queued contents
+// stay within memory.
+constexpr size_t kMaxPrefetchSize = 64 << 20;
+
+FileReport UnknownError(const std::exception& e) {
+    return {4, std::string("Unknown error encountered: ") + e.what() + "\n"};
+}
+
+/**
+ * @brief Creates the directories `out` goes to.
+ */
+FileReport CreateParent(const fs::path& out) {
+    std::error_code error;
+    fs::create_directories(out.parent_path(), error);
+    if (error) {
+        return {1, "Could not create directory `" +
+                       out.parent_path().string() + "`.\n"};
+    }
+    return {};
+}
+
+FileReport WriteOutput(const fs::path& out, std::string_view text) {
+    if (FileReport report = CreateParent(out); report.code_ != 0) {
+        return report;
+    }
+    std::optional<FdSink> sink;
+    try {
+        sink.emplace(out.string());
+    } catch (const std::system_error&) {
+        return {1, "Could not open `" + out.string() + "` for writing.\n"};
+    }
+    try {
+        sink->Write(text);
+        sink->Flush();
+    } catch (const std::system_error& e) {
+        return {1, std::string(e.what()) + ".\n"};
+    }
+    return {};
+}
+
+/**
+ * @brief Writes `count` and `noun`, in plural unless `count` is 1.
+ */
+void PrintCount(std::ostream& out, size_t count, std::string_view noun) {
+    out << count << ' ' << noun << (count == 1 ? "" : "s");
+}
+
+void PrintQueueStats(std::ostream& out, const char* name,
+                     const QueueStats& stats, size_t capacity) {
+    out << name << " queue: depth " << capacity << ", peak "
+        << stats.peak_size_ << ", " << stats.full_waits_ << " waits for room, "
+        << stats.empty_waits_ << " waits for items.\n";
+}
+
+/**
+ * @brief Formats `files` in `order` with a pipeline of three stages joined by
+ * bounded queues, so that reading and writing overlap with formatting:
+ *  - readers load the contents of files into memory,
+ *  - workers format them into memory,
+ *  - writers write the outputs, taking all queued ones at a time.
+ *
+ * Streamed files are written by the workers directly. Workers look outputs
+ * up in `cache` and writers add them to it, unless it is null. Returns a
+ * summary of how busy the stages and queues were.
+ */
+std::string RunPipeline(std::vector<BatchFile>& files,
+                        const std::vector<size_t>& order,
+                        const Options& options, FormatCache* cache) {
+    Options file_options = options;
+    file_options.jobs_ = 1;
+    BoundedQueue<ReadItem> read_queue(options.read_queue_);
+    BoundedQueue<FormattedItem> write_queue(options.write_queue_);
+    // No stage has more threads than files.
+    size_t max_threads = std::max<size_t>(files.size(), 1);
+    StageStats reading{"reading",
+                       std::clamp<size_t>(options.readers_, 1, max_threads)};
+    StageStats formatting{"formatting",
+                          std::clamp<size_t>(options.jobs_, 1, max_threads)};
+    StageStats writing{"writing",
+                       std::clamp<size_t>(options.writers_, 1, max_threads)};
+
+    std::thread readers([&] {
+        ParallelForStealing(files.size(), reading.threads_, [&](size_t i) {
+            BatchFile& file = files[order[i]];
+            std::optional<Source> source;
+            reading.Time([&] {
+                try {
+                    source = file.size_ > kMaxPrefetchSize
+                                 ? Source::FromFile(file.in_.string())
+                                 : Source::ReadFile(file.in_.string());
+                } catch (const std::system_error&) {
+                    file.report_ = {1, "File `" + file.in_.string() +
+                                           "` does not exist.\n"};
+                } catch (const std::exception& e) {
+                    file.report_ = UnknownError(e);
+                }
+            });
+            if (source) {
+                read_queue.Push({order[i], std::move(*source)});
+            }
+        });
+        read_queue.Close();
+    });
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < formatting.threads_; ++i) {
+        workers.emplace_back([&] {
+            while (std::optional<ReadItem> item = read_queue.Pop()) {
+                BatchFile& file = files[item->file_];
+                bool stream = IsStreamed(item->source_, options);
+                std::string_view input = item->source_.View();
+                std::string text;
+                std::string key;
+                formatting.Time([&] {
+                    try {
+                        if (options.check_) {
+                            file.report_ =
+                                CheckSource(item->source_, file.in_.string(),
+                                            file_options, cache);
+                        } else if (options.diff_) {
+                            file.report_ =
+                                DiffSource(item->source_, file.in_.string(),
+                                           file_options, cache, file.diff_);
+                        } else if (stream && options.in_place_) {
+                            file.report_ = FormatSourceInPlace(
+                                item->source_, file.in_.string(),
+                                file_options);
+                        } else if (stream) {
+                            file.report_ = CreateParent(file.out_);
+                            if (file.report_.code_ == 0) {
+                                file.report_ = FormatToFile(
+                                    item->source_, file.in_.string(),
+                                    file.out_.string(), file_options);
+                            }
+                        } else {
+                            std::optional<std::string> cached;
+                            if (cache != nullptr) {
+                                key = cache->GetKey(input, options.spaces_);
+                                cached = cache->Find(key, input);
+                            }
+                            if (cached) {
+                                text = std::move(*cached);
+                                key.clear();
+                            } else {
+                                file.report_ = FormatToString(
+                                    item->source_, text, file_options);
+                            }
+                        }
+                    } catch (const std::exception& e) {
+                        file.report_ = UnknownError(e);
+                    }
+                });
+                if (stream || options.check_ || options.diff_ ||
+                    file.report_.code_ != 0) {
+                    continue;
+                }
+                if (options.in_place_ && text == input) {
+                    // Files formatted already are left untouched.
+                    if (!key.empty()) {
+                        cache->Store(key, input, text);
+                    }
+                    continue;
+                }
+                write_queue.Push({item->file_, std::move(text), std::move(key),
+                                  item->source_});
+            }
+        });
+    }
+
+    std::vector<std::thread> writers;
+    for (size_t i = 0; i < writing.threads_; ++i) {
+        writers.emplace_back([&] {
+            while (true) {
+                std::vector<FormattedItem> batch =
+                    write_queue.PopBatch(write_queue.Capacity());
+                if (batch.empty()) {
+                    return;
+                }
+                writing.Time([&] {
+                    for (const FormattedItem& item : batch) {
+                        BatchFile& file = files[item.file_];
+                        // Stored first: the output may overwrite a mapped
+                        // input.
+                        if (!item.key_.empty()) {
+                            cache->Store(item.key_, item.source_.View(),
+                                         item.text_);
+                        }
+                        if (!options.in_place_) {
+                            file.report_ = WriteOutput(file.out_, item.text_);
+                        } else {
+                            file.report_ =
+                                WriteInPlace(file.in_.string(), item.text_);
+                            // The next run finds the new contents formatted.
+                            if (file.report_.code_ == 0 && cache != nullptr) {
+                                cache->Store(
+                                    cache->GetKey(item.text_, options.spaces_),
+                                    item.text_, item.text_);
+                            }
+                        }
+                    }
+                });
+            }
+        });
+    }
+
+    readers.join();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    write_queue.Close();
+    for (std::thread& writer : writers) {
+        writer.join();
+    }
+
+    std::ostringstream summary;
+    summary << "Pipeline: ";
+    PrintCount(summary, reading.threads_, "reader");
+    summary << ", ";
+    PrintCount(summary, formatting.threads_, "worker");
+    summary << ", ";
+    PrintCount(summary, writing.threads_, "writer");
+    summary << ".\n";
+    PrintQueueStats(summary, "Read", read_queue.GetStats(),
+                    read_queue.Capacity());
+    PrintQueueStats(summary, "Write", write_queue.GetStats(),
+                    write_queue.Capacity());
+    summary << "Busy time:" << std::fixed << std::setprecision(3);
+    const char* separator = " ";
+    for (const StageStats* stage : {&reading, &formatting, &writing}) {
+        summary << separator << stage->name_ << ' '
+                << static_cast<double>(stage->busy_) / 1e9 << " s";
+        separator = ", ";
+    }
+    summary << ".\n";
+    return summary.str();
+}
+
+}  // namespace
+
+int RunBatch(const Options& options, FormatCache* cache) {
+    std::vector<fs::path> paths(options.paths_.begin(), options.paths_.end());
+    if (!options.files_from_.empty()) {
+        std::ifstream list_file;
+        if (options.files_from_ != "-") {
+            list_file.open(options.files_from_);
+            if (!list_file) {
+                std::cerr << "File `" << options.files_from_
+                          << "` does not exist.\n";
+                return 1;
+            }
+        }
+        std::istream& list = options.files_from_ == "-" ? std::cin : list_file;
+        for (std::string line; std::getline(list, line);) {
+            if (!line.empty()) {
+                paths.emplace_back(line);
+            }
+        }
+    }
+
+    int code = 0;
+    std::vector<fs::path> inputs;
+    for (const fs::path& path : paths) {
+        std::error_code error;
+        if (!fs::is_directory(path, error)) {
+            // Missing files are reported when formatting them.
+            inputs.push_back(path);
+            continue;
+        }
+        try {
+            CollectDirectory(path, options, inputs);
+        } catch (const fs::filesystem_error&) {
+            std::cerr << "Could not read directory `" << path.string()
+                      << "`.\n";
+            code = 1;
+        }
+    }
+    // The same file given twice would be written twice at once.
+    std::vector<BatchFile> files;
+    std::set<fs::path> seen;
+    for (const fs::path& in : inputs) {
+        // In place, links to the same file would replace it twice at once.
+        std::error_code error;
+        fs::path identity = options.in_place_ ? fs::weakly_canonical(in, error)
+                                              : in.lexically_normal();
+        if (seen.insert(error ? in.lexically_normal() : identity).second) {
+            uintmax_t size = fs::file_size(in, error);
+            files.push_back({in, OutputPath(options.output_dir_, in),
+                             error ? 0 : size, {}, {}});
+        }
+    }
+
+    // Largest files go first, so that no thread is left with a big one at
+    // the end while the others are idle.
+    std::vector<size_t> order(files.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&files](size_t a, size_t b) {
+        return files[a].size_ > files[b].size_;
+    });
+    std::string pipeline_summary = RunPipeline(files, order, options, cache);
+
+    if (options.diff_) {
+        for (const BatchFile& file : files) {
+            std::cout << file.diff_;
+        }
+        std::cout.flush();
+    }
+    // Failures per exit code.
+    std::array<size_t, 6> failures = {};
+    for (const BatchFile& file : files) {
+        if (file.report_.code_ != 0) {
+            if (!file.report_.message_.empty()) {
+                std::cerr << file.in_.string() << ": "
+                          << file.report_.message_;
+            }
+            ++failures[file.report_.code_];
+            code = std::max(code, file.report_.code_);
+        }
+    }
+    size_t failed =
+        std::accumulate(failures.begin(), failures.end(), size_t{0});
+    if (options.check_ || options.diff_) {
+        std::cerr << "Checked " << files.size() << " files";
+    } else {
+        std::cerr << "Formatted " << files.size() - failed << " of "
+                  << files.size() << " files";
+    }
+    if (options.in_place_ || cache != nullptr) {
+        size_t changed = std::count_if(
+            files.begin(), files.end(),
+            [](const BatchFile& file) { return file.report_.changed_; });
+        std::cerr << " (";
+        if (options.in_place_) {
+            std::cerr << changed << " changed"
+                      << (cache != nullptr ? ", " : "");
+        }
+        if (cache != nullptr) {
+            std::cerr << cache->GetHits() << " cached";
+        }
+        std::cerr << ")";
+    }
+    static constexpr std::array<const char*, 6> kCategories = {
+        "",
+        "input/output error",
+        "tokenizer error",
+        "parser error",
+        "unknown error",
+        "unformatted file"};
+    std::string_view separator = ": ";
+    for (size_t i = 1; i < failures.size(); ++i) {
+        if (failures[i] != 0) {
+            std::cerr << separator;
+            PrintCount(std::cerr, failures[i], kCategories[i]);
+            separator = ", ";
+        }
+    }
+    std::cerr << ".\n";
+    if (options.stats_) {
+        std::cerr << pipeline_summary;
+    }
+    return code;
+}
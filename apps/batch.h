@@ -0,0 +1,17 @@
+#pragma once
+
+#include "format.h"
+
+/**
+ * @brief Formats every file named in `options.paths_` and the list in
+ * `options.files_from_` into `options.output_dir_`, largest files first.
+ * Files are read, formatted and written by separate stages running at once,
+ * with `options.readers_`, `options.jobs_` and `options.writers_` threads.
+ * Outputs are looked up in and added to `cache` unless it is null.
+ *
+ * Directories are searched recursively for files whose path relative to the
+ * directory matches one of `options.includes_` (any file if there are none)
+ * and none of `options.excludes_`. Errors are reported per file once all files
+ * are done, followed by a summary. Returns the highest exit code of the files.
+ */
+int RunBatch(const Options& options, FormatCache* cache = nullptr);
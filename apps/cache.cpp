@@ -0,0 +1,264 @@
+#include "cache.h"
+
+#include <parser/sink.h>
+#include <parser/source.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <random>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr std::string_view kMagic = "BTFY";
+constexpr char kCanonical = 'C';
+constexpr char kFormatted = 'F';
+constexpr size_t kHeaderSize = kMagic.size() + 1 + sizeof(uint64_t);
+
+// Evicting goes a bit below the limit, so that it is not needed again right
+// after the next few stores.
+constexpr uint64_t kEvictToPercent = 90;
+
+// Temporary files are left only by processes that died while storing an
+// entry; younger ones may still be in use.
+constexpr auto kStaleTempAge = std::chrono::hours(1);
+
+constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87;
+constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4F;
+constexpr uint64_t kPrime3 = 0x165667B19E3779F9;
+
+uint64_t RotateLeft(uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+uint64_t ReadWord(const char* p) {
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+uint64_t Round(uint64_t acc, uint64_t word) {
+    return RotateLeft(acc + word * kPrime2, 31) * kPrime1;
+}
+
+/**
+ * @brief Hashes `data` in the manner of XXH64: four independent lanes over
+ * 32-byte blocks, then the tail, then a final avalanche.
+ */
+uint64_t Hash(std::string_view data, uint64_t seed) {
+    const char* p = data.data();
+    const char* end = p + data.size();
+    uint64_t hash;
+    if (data.size() >= 32) {
+        std::array<uint64_t, 4> lanes = {seed + kPrime1 + kPrime2,
+                                         seed + kPrime2, seed,
+                                         seed - kPrime1};
+        for (; end - p >= 32; p += 32) {
+            for (size_t i = 0; i < lanes.size(); ++i) {
+                lanes[i] = Round(lanes[i], ReadWord(p + 8 * i));
+            }
+        }
+        hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) +
+               RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+        for (uint64_t lane : lanes) {
+            hash = (hash ^ Round(0, lane)) * kPrime1 + kPrime3;
+        }
+    } else {
+        hash = seed + kPrime3;
+    }
+    hash += data.size();
+    for (; end - p >= 8; p += 8) {
+        hash = RotateLeft(hash ^ Round(0, ReadWord(p)), 27) * kPrime1 + kPrime3;
+    }
+    for (; p != end; ++p) {
+        hash = RotateLeft(hash ^ static_cast<unsigned char>(*p) * kPrime3, 11) *
+               kPrime1;
+    }
+    hash ^= hash >> 33;
+    hash *= kPrime2;
+    hash ^= hash >> 29;
+    hash *= kPrime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/**
+ * @brief Gets a name for a temporary file no other thread or process uses.
+ */
+std::string GetTempSuffix() {
+    static const uint64_t kProcessTag = std::random_device()();
+    static std::atomic<uint64_t> counter = 0;
+    uint64_t thread_tag = std::hash<std::thread::id>()(
+        std::this_thread::get_id());
+    std::string suffix = ".";
+    suffix += std::to_string(kProcessTag ^ thread_tag);
+    suffix += '.';
+    suffix += std::to_string(counter++);
+    suffix += ".tmp";
+    return suffix;
+}
+
+}  // namespace
+
+fs::path FormatCache::DefaultDirectory() {
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+        return fs::path(xdg) / "beautify";
+    }
+    if (const char* home = std::getenv("HOME"); home && *home) {
+        return fs::path(home) / ".cache" / "beautify";
+    }
+    std::error_code error;
+    return fs::temp_directory_path(error) / "beautify-cache";
+}
+
+FormatCache::FormatCache(fs::path dir, uint64_t max_size,
+                         CacheEviction eviction)
+    : dir_(std::move(dir)), max_size_(max_size), eviction_(eviction) {
+}
+
+std::string FormatCache::GetKey(std::string_view input,
+                                size_t spaces_per_tab) const {
+    uint64_t seed = (uint64_t{kFormatVersion} << 32) ^ spaces_per_tab;
+    char key[17];
+    std::snprintf(key, sizeof(key), "%016llx",
+                  static_cast<unsigned long long>(Hash(input, seed)));
+    std::string result = key;
+    result += '-';
+    result += std::to_string(input.size());
+    return result;
+}
+
+std::optional<std::string> FormatCache::Find(const std::string& key,
+                                             std::string_view input) {
+    fs::path path = GetPath(key);
+    Source entry;
+    try {
+        entry = Source::ReadFile(path.string());
+    } catch (const std::system_error&) {
+        return std::nullopt;
+    }
+    std::string_view view = entry.View();
+    if (view.size() < kHeaderSize || !view.starts_with(kMagic) ||
+        ReadWord(view.data() + kMagic.size() + 1) != input.size()) {
+        return std::nullopt;
+    }
+    char kind = view[kMagic.size()];
+    if (kind != kCanonical && kind != kFormatted) {
+        return std::nullopt;
+    }
+    if (eviction_ == CacheEviction::LRU) {
+        std::error_code error;
+        fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+    }
+    ++hits_;
+    if (kind == kCanonical) {
+        return std::string(input);
+    }
+    return std::string(view.substr(kHeaderSize));
+}
+
+void FormatCache::Store(const std::string& key, std::string_view input,
+                        std::string_view output) {
+    fs::path path = GetPath(key);
+    fs::path temp = path;
+    temp += GetTempSuffix();
+    std::error_code error;
+    fs::create_directories(path.parent_path(), error);
+    if (error) {
+        return;
+    }
+    bool canonical = input == output;
+    uint64_t input_size = input.size();
+    char header[kHeaderSize];
+    kMagic.copy(header, kMagic.size());
+    header[kMagic.size()] = canonical ? kCanonical : kFormatted;
+    std::memcpy(header + kMagic.size() + 1, &input_size, sizeof(input_size));
+    try {
+        FdSink sink(temp.string());
+        sink.Write(std::string_view(header, sizeof(header)));
+        if (!canonical) {
+            sink.Write(output);
+        }
+        sink.Flush();
+    } catch (const std::system_error&) {
+        fs::remove(temp, error);
+        return;
+    }
+    // Renaming replaces an entry stored by someone else in the meantime at
+    // once, so readers never see a partial one.
+    fs::rename(temp, path, error);
+    if (error) {
+        fs::remove(temp, error);
+        return;
+    }
+    stored_ = true;
+}
+
+void FormatCache::Evict() {
+    if (!stored_.exchange(false)) {
+        return;
+    }
+    struct Entry {
+        fs::file_time_type time_;
+        uint64_t size_;
+        fs::path path_;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    auto now = fs::file_time_type::clock::now();
+    std::error_code error;
+    fs::recursive_directory_iterator it(dir_, error);
+    for (; !error && it != fs::recursive_directory_iterator();
+         it.increment(error)) {
+        std::error_code entry_error;
+        if (!it->is_regular_file(entry_error)) {
+            continue;
+        }
+        Entry entry{it->last_write_time(entry_error),
+                    it->file_size(entry_error), it->path()};
+        if (entry_error) {
+            continue;
+        }
+        total += entry.size_;
+        if (entry.path_.extension() != ".tmp" ||
+            now - entry.time_ > kStaleTempAge) {
+            entries.push_back(std::move(entry));
+        }
+    }
+    if (total <= max_size_) {
+        return;
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return a.time_ < b.time_; });
+    uint64_t target = max_size_ / 100 * kEvictToPercent;
+    for (const Entry& entry : entries) {
+        if (total <= target) {
+            break;
+        }
+        // Another process may be evicting too; files it removed already
+        // still count as gone.
+        fs::remove(entry.path_, error);
+        total -= entry.size_;
+    }
+}
+
+size_t FormatCache::GetHits() const {
+    return hits_;
+}
+
+fs::path FormatCache::GetPath(const std::string& key) const {
+    // Entries are spread over subdirectories to keep directories small.
+    std::string version = "v";
+    version += std::to_string(kFormatVersion);
+    return dir_ / version / key.substr(0, 2) / key;
+}
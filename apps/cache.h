@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+/**
+ * @enum class CacheEviction
+ * @brief Which entries `FormatCache` removes first once it is over its size
+ * limit: the least recently used ones or the oldest ones.
+ */
+enum class CacheEviction { LRU, FIFO };
+
+/**
+ * @class FormatCache
+ * @brief On-disk cache of formatted files, keyed by a hash of the input, the
+ * options the output depends on and the formatter version.
+ *
+ * An entry either records that the input is already formatted or holds the
+ * formatted output. Entries are written to a temporary file and renamed into
+ * place, so processes sharing the directory only ever see complete entries.
+ * Failing to read or write the cache is never an error: the file is then just
+ * formatted again.
+ */
+class FormatCache {
+public:
+    /**
+     * @brief Version of the output format, to be bumped whenever the
+     * formatter's output changes so that older entries stop matching.
+     */
+    static constexpr uint32_t kFormatVersion = 1;
+
+    static constexpr uint64_t kDefaultMaxSize = uint64_t{256} << 20;
+
+    /**
+     * @brief Gets the default cache directory: `beautify` under
+     * `$XDG_CACHE_HOME`, `$HOME/.cache` or the temporary directory.
+     */
+    static std::filesystem::path DefaultDirectory();
+
+    FormatCache(std::filesystem::path dir, uint64_t max_size,
+                CacheEviction eviction);
+
+    /**
+     * @brief Gets the key of `input` formatted with `spaces_per_tab`.
+     */
+    std::string GetKey(std::string_view input, size_t spaces_per_tab) const;
+
+    /**
+     * @brief Gets the formatted `input` stored under `key`, if any.
+     */
+    std::optional<std::string> Find(const std::string& key,
+                                    std::string_view input);
+
+    /**
+     * @brief Stores `output`, the formatted `input`, under `key`.
+     */
+    void Store(const std::string& key, std::string_view input,
+               std::string_view output);
+
+    /**
+     * @brief Removes entries until the cache is within its size limit, if
+     * anything was stored since the last call.
+     */
+    void Evict();
+
+    size_t GetHits() const;
+
+private:
+    std::filesystem::path GetPath(const std::string& key) const;
+
+    std::filesystem::path dir_;
+    uint64_t max_size_;
+    CacheEviction eviction_;
+    std::atomic<size_t> hits_ = 0;
+    std::atomic<bool> stored_ = false;
+};
@@ -0,0 +1,413 @@
+#include "diff.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Cost after which the middle snake search gives up on the shortest diff;
+// it grows with the square root of the size, as in xdiff.
+constexpr int64_t kMinMaxCost = 256;
+
+std::vector<std::string_view> SplitLines(std::string_view text) {
+    std::vector<std::string_view> lines;
+    while (!text.empty()) {
+        size_t end = text.find('\n');
+        end = end == std::string_view::npos ? text.size() : end + 1;
+        lines.push_back(text.substr(0, end));
+        text.remove_prefix(end);
+    }
+    return lines;
+}
+
+/**
+ * @class Myers
+ * @brief Marks lines of two sequences of line ids that are not on a shortest
+ * (or, past the cost limit, short) path of the edit graph.
+ *
+ * Ranges are split at the middle snake found by searching from both ends at
+ * once, so only two diagonal vectors are kept; the halves are compared
+ * independently.
+ */
+class Myers {
+public:
+    Myers(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b,
+          std::vector<char>& a_changed, std::vector<char>& b_changed)
+        : a_(a),
+          b_(b),
+          a_changed_(a_changed),
+          b_changed_(b_changed),
+          offset_(static_cast<int64_t>(b.size()) + 1),
+          forward_(a.size() + b.size() + 3),
+          backward_(a.size() + b.size() + 3),
+          max_cost_(std::max(
+              kMinMaxCost, static_cast<int64_t>(std::sqrt(
+                               static_cast<double>(a.size() + b.size()))))) {
+    }
+
+    void Run() {
+        std::vector<Range> ranges = {
+            {0, static_cast<int64_t>(a_.size()), 0,
+             static_cast<int64_t>(b_.size())}};
+        while (!ranges.empty()) {
+            Range range = ranges.back();
+            ranges.pop_back();
+            Trim(range);
+            if (range.a_begin_ == range.a_end_ ||
+                range.b_begin_ == range.b_end_) {
+                std::fill(a_changed_.begin() + range.a_begin_,
+                          a_changed_.begin() + range.a_end_, 1);
+                std::fill(b_changed_.begin() + range.b_begin_,
+                          b_changed_.begin() + range.b_end_, 1);
+                continue;
+            }
+            auto [x, y] = Split(range);
+            ranges.push_back({range.a_begin_, x, range.b_begin_, y});
+            ranges.push_back({x, range.a_end_, y, range.b_end_});
+        }
+    }
+
+private:
+    struct Range {
+        int64_t a_begin_;
+        int64_t a_end_;
+        int64_t b_begin_;
+        int64_t b_end_;
+    };
+
+    /**
+     * @brief Drops the common prefix and suffix of a range.
+     */
+    void Trim(Range& range) const {
+        while (range.a_begin_ < range.a_end_ &&
+               range.b_begin_ < range.b_end_ &&
+               a_[range.a_begin_] == b_[range.b_begin_]) {
+            ++range.a_begin_;
+            ++range.b_begin_;
+        }
+        while (range.a_begin_ < range.a_end_ &&
+               range.b_begin_ < range.b_end_ &&
+               a_[range.a_end_ - 1] == b_[range.b_end_ - 1]) {
+            --range.a_end_;
+            --range.b_end_;
+        }
+    }
+
+    int64_t& Forward(int64_t diagonal) {
+        return forward_[diagonal + offset_];
+    }
+
+    int64_t& Backward(int64_t diagonal) {
+        return backward_[diagonal + offset_];
+    }
+
+    /**
+     * @brief Finds where to split a trimmed range with both sides non-empty.
+     * Diagonals are numbered by `x - y`; `Forward(k)` and `Backward(k)` hold
+     * the furthest `x` reached on diagonal `k` from either end.
+     */
+    std::pair<int64_t, int64_t> Split(const Range& r) {
+        const int64_t min_diagonal = r.a_begin_ - r.b_end_;
+        const int64_t max_diagonal = r.a_end_ - r.b_begin_;
+        const int64_t forward_mid = r.a_begin_ - r.b_begin_;
+        const int64_t backward_mid = r.a_end_ - r.b_end_;
+        const bool odd = (forward_mid - backward_mid) % 2 != 0;
+        int64_t forward_min = forward_mid;
+        int64_t forward_max = forward_mid;
+        int64_t backward_min = backward_mid;
+        int64_t backward_max = backward_mid;
+        Forward(forward_mid) = r.a_begin_;
+        Backward(backward_mid) = r.a_end_;
+
+        for (int64_t cost = 1;; ++cost) {
+            if (forward_min > min_diagonal) {
+                Forward(--forward_min - 1) = -1;
+            } else {
+                ++forward_min;
+            }
+            if (forward_max < max_diagonal) {
+                Forward(++forward_max + 1) = -1;
+            } else {
+                --forward_max;
+            }
+            for (int64_t d = forward_max; d >= forward_min; d -= 2) {
+                int64_t x = Forward(d - 1) >= Forward(d + 1)
+                                ? Forward(d - 1) + 1
+                                : Forward(d + 1);
+                int64_t y = x - d;
+                while (x < r.a_end_ && y < r.b_end_ && a_[x] == b_[y]) {
+                    ++x;
+                    ++y;
+                }
+                Forward(d) = x;
+                if (odd && backward_min <= d && d <= backward_max &&
+                    Backward(d) <= x) {
+                    return {x, y};
+                }
+            }
+
+            if (backward_min > min_diagonal) {
+                Backward(--backward_min - 1) =
+                    std::numeric_limits<int64_t>::max();
+            } else {
+                ++backward_min;
+            }
+            if (backward_max < max_diagonal) {
+                Backward(++backward_max + 1) =
+                    std::numeric_limits<int64_t>::max();
+            } else {
+                --backward_max;
+            }
+            for (int64_t d = backward_max; d >= backward_min; d -= 2) {
+                int64_t x = Backward(d - 1) < Backward(d + 1)
+                                ? Backward(d - 1)
+                                : Backward(d + 1) - 1;
+                int64_t y = x - d;
+                while (x > r.a_begin_ && y > r.b_begin_ &&
+                       a_[x - 1] == b_[y - 1]) {
+                    --x;
+                    --y;
+                }
+                Backward(d) = x;
+                if (!odd && forward_min <= d && d <= forward_max &&
+                    x <= Forward(d)) {
+                    return {x, y};
+                }
+            }
+
+            if (cost >= max_cost_) {
+                return SplitAtFurthest(r, forward_min, forward_max,
+                                       backward_min, backward_max);
+            }
+        }
+    }
+
+    /**
+     * @brief Splits a range too costly to search further at the point that
+     * got furthest from its end, going forward or backward.
+     */
+    std::pair<int64_t, int64_t> SplitAtFurthest(const Range& r,
+                                                int64_t forward_min,
+                                                int64_t forward_max,
+                                                int64_t backward_min,
+                                                int64_t backward_max) {
+        int64_t forward_best = -1;
+        int64_t forward_x = 0;
+        for (int64_t d = forward_max; d >= forward_min; d -= 2) {
+            int64_t x = std::min(Forward(d), r.a_end_);
+            int64_t y = x - d;
+            if (y > r.b_end_) {
+                x = r.b_end_ + d;
+                y = r.b_end_;
+            }
+            if (forward_best < x + y) {
+                forward_best = x + y;
+                forward_x = x;
+            }
+        }
+        int64_t backward_best = std::numeric_limits<int64_t>::max();
+        int64_t backward_x = 0;
+        for (int64_t d = backward_max; d >= backward_min; d -= 2) {
+            int64_t x = std::max(r.a_begin_, Backward(d));
+            int64_t y = x - d;
+            if (y < r.b_begin_) {
+                x = r.b_begin_ + d;
+                y = r.b_begin_;
+            }
+            if (x + y < backward_best) {
+                backward_best = x + y;
+                backward_x = x;
+            }
+        }
+        if ((r.a_end_ + r.b_end_) - backward_best <
+            forward_best - (r.a_begin_ + r.b_begin_)) {
+            return {forward_x, forward_best - forward_x};
+        }
+        return {backward_x, backward_best - backward_x};
+    }
+
+    const std::vector<uint32_t>& a_;
+    const std::vector<uint32_t>& b_;
+    std::vector<char>& a_changed_;
+    std::vector<char>& b_changed_;
+    int64_t offset_;
+    std::vector<int64_t> forward_;
+    std::vector<int64_t> backward_;
+    int64_t max_cost_;
+};
+
+/**
+ * @brief Marks changed lines of `a` and `b`, given as line ids.
+ *
+ * Lines missing on the other side altogether are changed for sure, so only
+ * the remaining ones are compared, which keeps the search small when many
+ * lines are rewritten.
+ */
+void MarkChanges(const std::vector<uint32_t>& a,
+                 const std::vector<uint32_t>& b, size_t id_count,
+                 std::vector<char>& a_changed, std::vector<char>& b_changed) {
+    std::vector<char> in_a(id_count);
+    std::vector<char> in_b(id_count);
+    for (uint32_t id : a) {
+        in_a[id] = 1;
+    }
+    for (uint32_t id : b) {
+        in_b[id] = 1;
+    }
+    auto keep = [](const std::vector<uint32_t>& lines,
+                   const std::vector<char>& in_other,
+                   std::vector<char>& changed, std::vector<uint32_t>& kept,
+                   std::vector<size_t>& kept_index) {
+        for (size_t i = 0; i < lines.size(); ++i) {
+            if (in_other[lines[i]]) {
+                kept.push_back(lines[i]);
+                kept_index.push_back(i);
+            } else {
+                changed[i] = 1;
+            }
+        }
+    };
+    std::vector<uint32_t> a_kept;
+    std::vector<uint32_t> b_kept;
+    std::vector<size_t> a_index;
+    std::vector<size_t> b_index;
+    keep(a, in_b, a_changed, a_kept, a_index);
+    keep(b, in_a, b_changed, b_kept, b_index);
+
+    std::vector<char> a_kept_changed(a_kept.size());
+    std::vector<char> b_kept_changed(b_kept.size());
+    Myers(a_kept, b_kept, a_kept_changed, b_kept_changed).Run();
+    for (size_t i = 0; i < a_kept.size(); ++i) {
+        a_changed[a_index[i]] = a_kept_changed[i];
+    }
+    for (size_t i = 0; i < b_kept.size(); ++i) {
+        b_changed[b_index[i]] = b_kept_changed[i];
+    }
+}
+
+/**
+ * @struct Change
+ * @brief Run of changed lines: `[a_begin_, a_end_)` replaced with
+ * `[b_begin_, b_end_)`.
+ */
+struct Change {
+    size_t a_begin_;
+    size_t a_end_;
+    size_t b_begin_;
+    size_t b_end_;
+};
+
+void AppendLine(std::string& out, char prefix, std::string_view line) {
+    out += prefix;
+    out += line;
+    if (!line.ends_with('\n')) {
+        out += "\n\\ No newline at end of file\n";
+    }
+}
+
+/**
+ * @brief Appends a hunk range: the 1-based first line and the line count,
+ * which is left out if it is 1. Empty ranges start at the line before.
+ */
+void AppendRange(std::string& out, size_t begin, size_t end) {
+    size_t count = end - begin;
+    out += std::to_string(count == 0 ? begin : begin + 1);
+    if (count != 1) {
+        out += ',';
+        out += std::to_string(count);
+    }
+}
+
+}  // namespace
+
+std::string UnifiedDiff(std::string_view old_text, std::string_view new_text,
+                        const std::string& old_name,
+                        const std::string& new_name, size_t context) {
+    if (old_text == new_text) {
+        return {};
+    }
+    std::vector<std::string_view> a_lines = SplitLines(old_text);
+    std::vector<std::string_view> b_lines = SplitLines(new_text);
+    std::unordered_map<std::string_view, uint32_t> ids;
+    auto intern = [&ids](const std::vector<std::string_view>& lines) {
+        std::vector<uint32_t> line_ids;
+        line_ids.reserve(lines.size());
+        for (std::string_view line : lines) {
+            auto it =
+                ids.emplace(line, static_cast<uint32_t>(ids.size())).first;
+            line_ids.push_back(it->second);
+        }
+        return line_ids;
+    };
+    std::vector<uint32_t> a = intern(a_lines);
+    std::vector<uint32_t> b = intern(b_lines);
+    std::vector<char> a_changed(a.size());
+    std::vector<char> b_changed(b.size());
+    MarkChanges(a, b, ids.size(), a_changed, b_changed);
+
+    // Unchanged lines pair up in order, so runs of changes are found by
+    // walking both sides at once.
+    std::vector<Change> changes;
+    for (size_t i = 0, j = 0; i < a.size() || j < b.size();) {
+        if (i < a.size() && j < b.size() && !a_changed[i] && !b_changed[j]) {
+            ++i;
+            ++j;
+            continue;
+        }
+        Change change{i, i, j, j};
+        while (i < a.size() && a_changed[i]) {
+            ++i;
+        }
+        while (j < b.size() && b_changed[j]) {
+            ++j;
+        }
+        change.a_end_ = i;
+        change.b_end_ = j;
+        changes.push_back(change);
+    }
+
+    std::string out = "--- " + old_name + "\n+++ " + new_name + "\n";
+    for (size_t first = 0; first < changes.size();) {
+        // Changes close enough to share context go in the same hunk.
+        size_t last = first;
+        while (last + 1 < changes.size() &&
+               changes[last + 1].a_begin_ - changes[last].a_end_ <=
+                   2 * context) {
+            ++last;
+        }
+        size_t before = std::min(context, changes[first].a_begin_);
+        size_t after = std::min(context, a.size() - changes[last].a_end_);
+        size_t a_begin = changes[first].a_begin_ - before;
+        size_t b_begin = changes[first].b_begin_ - before;
+        size_t a_end = changes[last].a_end_ + after;
+        size_t b_end = changes[last].b_end_ + after;
+        out += "@@ -";
+        AppendRange(out, a_begin, a_end);
+        out += " +";
+        AppendRange(out, b_begin, b_end);
+        out += " @@\n";
+        size_t i = a_begin;
+        for (size_t k = first; k <= last; ++k) {
+            const Change& change = changes[k];
+            for (; i < change.a_begin_; ++i) {
+                AppendLine(out, ' ', a_lines[i]);
+            }
+            for (i = change.a_begin_; i < change.a_end_; ++i) {
+                AppendLine(out, '-', a_lines[i]);
+            }
+            for (size_t j = change.b_begin_; j < change.b_end_; ++j) {
+                AppendLine(out, '+', b_lines[j]);
+            }
+        }
+        for (; i < a_end; ++i) {
+            AppendLine(out, ' ', a_lines[i]);
+        }
+        first = last + 1;
+    }
+    return out;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Computes a unified diff of the lines of `old_text` and `new_text`,
+ * with `context` unchanged lines around every change and headed with
+ * `old_name` and `new_name`. Returns an empty string if the texts are equal.
+ *
+ * Lines are compared with Myers' algorithm in linear space. Past a cost limit
+ * the search settles for the furthest-reaching path instead of the shortest
+ * diff, so that very different big files do not take quadratic time.
+ */
+std::string UnifiedDiff(std::string_view old_text, std::string_view new_text,
+                        const std::string& old_name,
+                        const std::string& new_name, size_t context = 3);
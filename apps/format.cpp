@@ -0,0 +1,361 @@
+#include "format.h"
+
+#include "diff.h"
+
+#include <parser/formatter.h>
+#include <parser/parser.h>
+#include <parser/tokenizer.h>
+
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace {
+
+/**
+ * @struct ParsedFile
+ * @brief A file parsed the way its options ask for: one of `file_`,
+ * `outline_` and `preformatted_` is set.
+ */
+struct ParsedFile {
+    // Constructed in place: move-assigning would copy the declarations out of
+    // the arena.
+    std::optional<Module> file_;
+    std::optional<FileOutline> outline_;
+    std::optional<PreformattedFile> preformatted_;
+
+    template <OutputSink S>
+    void Generate(S& sink, const Source& source, const Options& options) {
+        CodeGenerator gen(sink);
+        if (outline_) {
+            gen.GenerateStreaming(source, options.spaces_, *outline_);
+        } else if (preformatted_) {
+            gen.Generate(*preformatted_);
+        } else {
+            gen.Generate(*file_);
+        }
+    }
+};
+
+/**
+ * @brief Gets the report of the exception being handled, so it has to be
+ * called from a `catch` block.
+ */
+FileReport ErrorReport() {
+    try {
+        throw;
+    } catch (const TokenizerError& e) {
+        return {2, std::string("TokenizerError: ") + e.what() + "\n"};
+    } catch (const ParserError& e) {
+        return {3, std::string("ParserError: ") + e.what() + "\n"};
+    } catch (const std::exception& e) {
+        return {4,
+                std::string("Unknown error encountered: ") + e.what() + "\n"};
+    }
+}
+
+/**
+ * @brief Parses `source` into `parsed`, returning the error if it fails.
+ */
+FileReport Parse(const Source& source, const Options& options,
+                 ParsedFile& parsed) {
+    Tokenizer tokenizer(source, options.spaces_);
+    try {
+        if (IsStreamed(source, options)) {
+            Parser parser(tokenizer);
+            parsed.outline_.emplace(parser.ParseOutline());
+        } else if (options.jobs_ > 1) {
+            TokenBuffer tokens = tokenizer.Tokenize(options.jobs_);
+            parsed.preformatted_.emplace(PreformatFile(tokens, options.jobs_));
+        } else {
+            TokenBuffer tokens = tokenizer.Tokenize();
+            Parser parser(tokens, Allocation::FLAT);
+            parsed.file_.emplace(parser.ParseFile());
+        }
+    } catch (...) {
+        return ErrorReport();
+    }
+    return {};
+}
+
+/**
+ * @brief Formats the range of lines of `source` given in `options` into
+ * `out`, copying the rest of it as is.
+ */
+FileReport FormatRange(const Source& source, std::string& out,
+                       const Options& options) {
+    std::string_view text = source.View();
+    TextEdit edit;
+    try {
+        edit = FormatLines(text, options.spaces_, options.first_line_,
+                           options.last_line_);
+    } catch (...) {
+        return ErrorReport();
+    }
+    out.reserve(text.size() - edit.length_ + edit.text_.size());
+    out.assign(text.substr(0, edit.offset_));
+    out.append(edit.text_);
+    out.append(text.substr(edit.offset_ + edit.length_));
+    return {};
+}
+
+FileReport ReplaceWith(const std::string& filename,
+                       const std::function<void(FdSink&)>& generate) {
+    try {
+        ReplaceFile(filename, generate);
+    } catch (const std::system_error& e) {
+        return {1, "Could not write `" + filename + "`: " + e.what() + ".\n"};
+    }
+    FileReport report;
+    report.changed_ = true;
+    return report;
+}
+
+/**
+ * @brief Checks whether `lhs` and `rhs` name the same existing file.
+ */
+bool IsSameFile(const std::string& lhs, const std::string& rhs) {
+    std::error_code error;
+    return std::filesystem::equivalent(lhs, rhs, error);
+}
+
+FileReport NotFormatted(const Source& source, const std::string& in_filename,
+                        const OutputMismatch& mismatch) {
+    size_t line = source.GetCoords(mismatch.GetOffset()).first;
+    return {5, "File `" + in_filename +
+                   "` is not formatted: the first difference is at line " +
+                   std::to_string(line) + ".\n"};
+}
+
+}  // namespace
+
+bool IsStreamed(const Source& source, const Options& options) {
+    // Files too big to be tokenized at once are always streamed.
+    return options.first_line_ == 0 &&
+           (options.stream_ || source.Size() > TokenBuffer::kMaxSourceSize);
+}
+
+FileReport FormatFile(const std::string& in_filename,
+                      const std::string& out_filename, const Options& options,
+                      FormatCache* cache) {
+    Source source;
+    try {
+        source = Source::FromFile(in_filename);
+    } catch (const std::system_error&) {
+        return {1, "File `" + in_filename + "` does not exist.\n"};
+    }
+    return FormatToFile(source, in_filename, out_filename, options, cache);
+}
+
+FileReport FormatToFile(const Source& source, const std::string& in_filename,
+                        const std::string& out_filename, const Options& options,
+                        FormatCache* cache) {
+    // Cached files and ranges of lines are formatted into memory, the others
+    // straight into the output.
+    std::optional<std::string> text;
+    ParsedFile parsed;
+    if ((cache != nullptr || options.first_line_ != 0) &&
+        !IsStreamed(source, options)) {
+        text.emplace();
+        FileReport report = FormatToString(source, *text, options, cache);
+        if (report.code_ != 0) {
+            return report;
+        }
+    } else if (FileReport report = Parse(source, options, parsed);
+               report.code_ != 0) {
+        return report;
+    }
+    if (parsed.outline_ && !out_filename.empty() &&
+        IsSameFile(in_filename, out_filename)) {
+        // Streaming reads the input again while writing, so a file formatted
+        // onto itself is only replaced once the output is complete.
+        try {
+            ReplaceFile(out_filename, [&](FdSink& sink) {
+                parsed.Generate(sink, source, options);
+            });
+        } catch (const std::system_error& e) {
+            return {1, "Could not write `" + out_filename + "`: " + e.what() +
+                           ".\n"};
+        }
+        return {};
+    }
+    // Constructed in place: sinks can be neither copied nor moved.
+    std::optional<FdSink> sink;
+    try {
+        if (out_filename.empty()) {
+            sink.emplace(FdSink::kStandardOutput);
+        } else {
+            sink.emplace(out_filename);
+        }
+    } catch (const std::system_error&) {
+        return {1, "Could not open `" + out_filename + "` for writing.\n"};
+    }
+    try {
+        if (text) {
+            sink->Write(*text);
+        } else {
+            parsed.Generate(*sink, source, options);
+        }
+        sink->Flush();
+    } catch (const std::system_error& e) {
+        return {1, std::string(e.what()) + ".\n"};
+    }
+    return {};
+}
+
+FileReport CheckFile(const std::string& in_filename, const Options& options,
+                     FormatCache* cache) {
+    Source source;
+    try {
+        source = Source::FromFile(in_filename);
+    } catch (const std::system_error&) {
+        return {1, "File `" + in_filename + "` does not exist.\n"};
+    }
+    return CheckSource(source, in_filename, options, cache);
+}
+
+FileReport CheckSource(const Source& source, const std::string& in_filename,
+                       const Options& options, FormatCache* cache) {
+    CompareSink sink(source.View());
+    if (options.first_line_ != 0) {
+        std::string text;
+        if (FileReport report = FormatRange(source, text, options);
+            report.code_ != 0) {
+            return report;
+        }
+        try {
+            sink.Write(text);
+            sink.Finish();
+        } catch (const OutputMismatch& e) {
+            return NotFormatted(source, in_filename, e);
+        }
+        return {};
+    }
+    std::string key;
+    bool cacheable = cache != nullptr && !IsStreamed(source, options);
+    if (cacheable) {
+        key = cache->GetKey(source.View(), options.spaces_);
+        if (std::optional<std::string> text = cache->Find(key, source.View())) {
+            try {
+                sink.Write(*text);
+                sink.Finish();
+            } catch (const OutputMismatch& e) {
+                return NotFormatted(source, in_filename, e);
+            }
+            return {};
+        }
+    }
+    ParsedFile parsed;
+    if (FileReport report = Parse(source, options, parsed); report.code_ != 0) {
+        return report;
+    }
+    try {
+        parsed.Generate(sink, source, options);
+        sink.Finish();
+    } catch (const OutputMismatch& e) {
+        return NotFormatted(source, in_filename, e);
+    }
+    if (cacheable) {
+        cache->Store(key, source.View(), source.View());
+    }
+    return {};
+}
+
+FileReport DiffFile(const std::string& filename, const Options& options,
+                    FormatCache* cache, std::string& diff) {
+    Source source;
+    try {
+        source = Source::FromFile(filename);
+    } catch (const std::system_error&) {
+        return {1, "File `" + filename + "` does not exist.\n"};
+    }
+    return DiffSource(source, filename, options, cache, diff);
+}
+
+FileReport DiffSource(const Source& source, const std::string& filename,
+                      const Options& options, FormatCache* cache,
+                      std::string& diff) {
+    std::string text;
+    FileReport report = FormatToString(source, text, options, cache);
+    if (report.code_ != 0 || text == source.View()) {
+        return report;
+    }
+    diff += UnifiedDiff(source.View(), text, "a/" + filename, "b/" + filename);
+    return {5, ""};
+}
+
+FileReport FormatToString(const Source& source, std::string& out,
+                          const Options& options, FormatCache* cache) {
+    if (options.first_line_ != 0) {
+        return FormatRange(source, out, options);
+    }
+    std::string key;
+    if (cache != nullptr) {
+        key = cache->GetKey(source.View(), options.spaces_);
+        if (std::optional<std::string> text = cache->Find(key, source.View())) {
+            out = std::move(*text);
+            return {};
+        }
+    }
+    ParsedFile parsed;
+    if (FileReport report = Parse(source, options, parsed); report.code_ != 0) {
+        return report;
+    }
+    StringSink sink;
+    parsed.Generate(sink, source, options);
+    out = sink.Release();
+    if (cache != nullptr) {
+        cache->Store(key, source.View(), out);
+    }
+    return {};
+}
+
+FileReport FormatInPlace(const std::string& filename, const Options& options,
+                         FormatCache* cache) {
+    Source source;
+    try {
+        source = Source::FromFile(filename);
+    } catch (const std::system_error&) {
+        return {1, "File `" + filename + "` does not exist.\n"};
+    }
+    return FormatSourceInPlace(source, filename, options, cache);
+}
+
+FileReport FormatSourceInPlace(const Source& source,
+                               const std::string& filename,
+                               const Options& options, FormatCache* cache) {
+    if (IsStreamed(source, options)) {
+        // Too big to be formatted into memory: the file is checked first and,
+        // if it is not formatted, formatted again straight into its
+        // replacement.
+        FileReport report = CheckSource(source, filename, options);
+        if (report.code_ != 5) {
+            return report;
+        }
+        ParsedFile parsed;
+        if (report = Parse(source, options, parsed); report.code_ != 0) {
+            return report;
+        }
+        return ReplaceWith(filename, [&](FdSink& sink) {
+            parsed.Generate(sink, source, options);
+        });
+    }
+    std::string text;
+    FileReport report = FormatToString(source, text, options, cache);
+    if (report.code_ != 0 || text == source.View()) {
+        return report;
+    }
+    report = WriteInPlace(filename, text);
+    if (report.code_ == 0 && cache != nullptr && options.first_line_ == 0) {
+        // The next run finds the new contents formatted.
+        cache->Store(cache->GetKey(text, options.spaces_), text, text);
+    }
+    return report;
+}
+
+FileReport WriteInPlace(const std::string& filename, std::string_view text) {
+    return ReplaceWith(filename, [text](FdSink& sink) { sink.Write(text); });
+}
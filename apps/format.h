@@ -0,0 +1,151 @@
+#pragma once
+
+#include "cache.h"
+
+#include <parser/source.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @struct Options
+ * @brief Command line options of `beautify`.
+ */
+struct Options {
+    std::string in_filename_;
+    std::string out_filename_;  // stdout if empty
+    size_t spaces_ = 8;
+    size_t jobs_ = 1;
+    bool stream_ = false;
+    bool check_ = false;  // only checks if the inputs are formatted already
+    bool in_place_ = false;
+    bool diff_ = false;  // prints what formatting would change
+
+    // Formats only the items overlapping lines `[first_line_, last_line_]`,
+    // counted from 1, unless `first_line_` is 0.
+    size_t first_line_ = 0;
+    size_t last_line_ = 0;
+
+    bool lsp_ = false;  // serves editors as a language server over stdio
+
+    // Batch mode, on when an output directory or a file list is given, or
+    // when checking, diffing or formatting in place anything but a single
+    // file.
+    bool batch_ = false;
+    std::vector<std::string> paths_;  // files and directories to format
+    std::string files_from_;          // "-" for stdin
+    std::vector<std::string> includes_;
+    std::vector<std::string> excludes_;
+    std::string output_dir_;
+    size_t readers_ = 1;
+    size_t writers_ = 1;
+    size_t read_queue_ = 8;
+    size_t write_queue_ = 8;
+    bool stats_ = false;  // prints how the stages of the batch went
+
+    // Cache of formatted files, off if the directory is empty.
+    std::string cache_dir_;
+    uint64_t cache_size_ = FormatCache::kDefaultMaxSize;
+    CacheEviction cache_eviction_ = CacheEviction::LRU;
+};
+
+/**
+ * @struct FileReport
+ * @brief Outcome of formatting one file: the exit code `beautify` would have
+ * for it alone and the error message, empty on success.
+ */
+struct FileReport {
+    int code_ = 0;
+    std::string message_;
+    bool changed_ = false;  // if the file was rewritten in place
+};
+
+/**
+ * @brief Checks if `source` is formatted one declaration at a time, which
+ * bypasses the cache. Ranges of lines never are.
+ */
+bool IsStreamed(const Source& source, const Options& options);
+
+/**
+ * @brief Formats `in_filename` into `out_filename`, or to stdout if it is
+ * empty, with `options.jobs_` threads. The output is looked up in and added
+ * to `cache` unless it is null.
+ *
+ * Exit codes are 1 for input and output errors, 2 for tokenizer errors, 3 for
+ * parser errors and 4 for anything else. Nothing is written if the file does
+ * not parse.
+ */
+FileReport FormatFile(const std::string& in_filename,
+                      const std::string& out_filename, const Options& options,
+                      FormatCache* cache = nullptr);
+
+/**
+ * @brief Variant of `FormatFile` for a source already read from
+ * `in_filename`.
+ */
+FileReport FormatToFile(const Source& source, const std::string& in_filename,
+                        const std::string& out_filename, const Options& options,
+                        FormatCache* cache = nullptr);
+
+/**
+ * @brief Checks if `in_filename` is formatted already, comparing the output
+ * against it as it is generated and stopping at the first difference. Files
+ * that are not formatted get exit code 5. Formatted ones are recorded in
+ * `cache` unless it is null.
+ */
+FileReport CheckFile(const std::string& in_filename, const Options& options,
+                     FormatCache* cache = nullptr);
+
+/**
+ * @brief Variant of `CheckFile` for a source already read.
+ */
+FileReport CheckSource(const Source& source, const std::string& in_filename,
+                       const Options& options, FormatCache* cache = nullptr);
+
+/**
+ * @brief Formats `filename` and appends a unified diff from it to the output
+ * to `diff`. Files that would change get exit code 5, as with `CheckFile`,
+ * with no message. The output is looked up in and added to `cache` unless it
+ * is null.
+ */
+FileReport DiffFile(const std::string& filename, const Options& options,
+                    FormatCache* cache, std::string& diff);
+
+/**
+ * @brief Variant of `DiffFile` for a source already read.
+ */
+FileReport DiffSource(const Source& source, const std::string& filename,
+                      const Options& options, FormatCache* cache,
+                      std::string& diff);
+
+/**
+ * @brief Formats `source` into `out`, which is left as is on errors. The
+ * output is looked up in and added to `cache` unless it is null or only a
+ * range of lines is formatted.
+ */
+FileReport FormatToString(const Source& source, std::string& out,
+                          const Options& options, FormatCache* cache = nullptr);
+
+/**
+ * @brief Formats `filename` in place, replacing it atomically and only if the
+ * output differs from it, so that unchanged files keep their modification
+ * time. The output is looked up in and added to `cache` unless it is null.
+ */
+FileReport FormatInPlace(const std::string& filename, const Options& options,
+                         FormatCache* cache = nullptr);
+
+/**
+ * @brief Variant of `FormatInPlace` for a source already read.
+ */
+FileReport FormatSourceInPlace(const Source& source,
+                               const std::string& filename,
+                               const Options& options,
+                               FormatCache* cache = nullptr);
+
+/**
+ * @brief Atomically replaces `filename` with `text`, keeping its permissions.
+ */
+FileReport WriteInPlace(const std::string& filename, std::string_view text);
@@ -0,0 +1,478 @@
+#include "json.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+/**
+ * @brief Nesting depth past which texts are rejected rather than parsed
+ * recursively.
+ */
+constexpr size_t kMaxDepth = 256;
+
+/**
+ * @class JsonParser
+ * @brief Recursive descent parser of a JSON text.
+ */
+class JsonParser {
+public:
+    explicit JsonParser(std::string_view text) : text_(text) {
+    }
+
+    JsonValue ParseText() {
+        JsonValue value = ParseValue(0);
+        SkipWhitespace();
+        if (pos_ != text_.size()) {
+            Fail("Unexpected data after the value");
+        }
+        return value;
+    }
+
+private:
+    [[noreturn]] void Fail(const std::string& msg) const {
+        throw JsonError(msg + " at offset " + std::to_string(pos_) + ".");
+    }
+
+    void SkipWhitespace() {
+        while (pos_ < text_.size() &&
+               (text_[pos_] == ' ' || text_[pos_] == '\t' ||
+                text_[pos_] == '\n' || text_[pos_] == '\r')) {
+            ++pos_;
+        }
+    }
+
+    /**
+     * @brief Skips whitespace and then `c` if it comes next.
+     *
+     * @return Returns whether it did.
+     */
+    bool Consume(char c) {
+        SkipWhitespace();
+        if (pos_ < text_.size() && text_[pos_] == c) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    void Expect(char c) {
+        if (!Consume(c)) {
+            Fail(std::string("Expected `") + c + "`");
+        }
+    }
+
+    void ExpectWord(std::string_view word) {
+        if (text_.substr(pos_, word.size()) != word) {
+            Fail("Unexpected character");
+        }
+        pos_ += word.size();
+    }
+
+    JsonValue ParseValue(size_t depth) {
+        if (depth > kMaxDepth) {
+            Fail("Nested too deeply");
+        }
+        SkipWhitespace();
+        if (pos_ == text_.size()) {
+            Fail("Unexpected end of text");
+        }
+        switch (text_[pos_]) {
+            case '{':
+                return ParseObject(depth);
+            case '[':
+                return ParseArray(depth);
+            case '"':
+                return ParseString();
+            case 't':
+                ExpectWord("true");
+                return true;
+            case 'f':
+                ExpectWord("false");
+                return false;
+            case 'n':
+                ExpectWord("null");
+                return JsonValue();
+            default:
+                return ParseNumber();
+        }
+    }
+
+    JsonValue ParseObject(size_t depth) {
+        ++pos_;
+        JsonValue::Object object;
+        if (Consume('}')) {
+            return object;
+        }
+        do {
+            SkipWhitespace();
+            if (pos_ == text_.size() || text_[pos_] != '"') {
+                Fail("Expected a member name");
+            }
+            std::string key = ParseString();
+            Expect(':');
+            object.emplace_back(std::move(key), ParseValue(depth + 1));
+        } while (Consume(','));
+        Expect('}');
+        return object;
+    }
+
+    JsonValue ParseArray(size_t depth) {
+        ++pos_;
+        JsonValue::Array array;
+        if (Consume(']')) {
+            return array;
+        }
+        do {
+            array.push_back(ParseValue(depth + 1));
+        } while (Consume(','));
+        Expect(']');
+        return array;
+    }
+
+    JsonValue ParseNumber() {
+        // `from_chars` would also take "inf" and "nan", which JSON does not.
+        size_t end = text_.find_first_not_of("0123456789+-.eE", pos_);
+        end = end == std::string_view::npos ? text_.size() : end;
+        double value;
+        auto [ptr, error] =
+            std::from_chars(text_.data() + pos_, text_.data() + end, value);
+        if (error != std::errc() || ptr == text_.data() + pos_) {
+            Fail("Invalid number");
+        }
+        pos_ = ptr - text_.data();
+        return value;
+    }
+
+    uint32_t ParseHex4() {
+        uint32_t code = 0;
+        auto [ptr, error] = std::from_chars(
+            text_.data() + pos_,
+            text_.data() + std::min(pos_ + 4, text_.size()), code, 16);
+        if (error != std::errc() || ptr != text_.data() + pos_ + 4) {
+            Fail("Invalid \\u escape");
+        }
+        pos_ += 4;
+        return code;
+    }
+
+    static void AppendUtf8(std::string& out, uint32_t code) {
+        if (code < 0x80) {
+            out.push_back(static_cast<char>(code));
+        } else if (code < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | code >> 6));
+            out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        } else if (code < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | code >> 12));
+            out.push_back(static_cast<char>(0x80 | (code >> 6 & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        } else {
+            out.push_back(static_cast<char>(0xF0 | code >> 18));
+            out.push_back(static_cast<char>(0x80 | (code >> 12 & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (code >> 6 & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        }
+    }
+
+    std::string ParseString() {
+        ++pos_;
+        std::string out;
+        while (true) {
+            // Runs without escapes, e.g. whole documents, are copied at once.
+            size_t end = pos_;
+            while (end < text_.size() && text_[end] != '"' &&
+                   text_[end] != '\\' &&
+                   static_cast<unsigned char>(text_[end]) >= 0x20) {
+                ++end;
+            }
+            out.append(text_, pos_, end - pos_);
+            pos_ = end;
+            if (pos_ == text_.size()) {
+                Fail("Unterminated string");
+            }
+            char c = text_[pos_++];
+            if (c == '"') {
+                return out;
+            }
+            if (c != '\\') {
+                Fail("Unescaped control character in a string");
+            }
+            if (pos_ == text_.size()) {
+                Fail("Unterminated string");
+            }
+            switch (text_[pos_++]) {
+                case '"':
+                    out.push_back('"');
+                    break;
+                case '\\':
+                    out.push_back('\\');
+                    break;
+                case '/':
+                    out.push_back('/');
+                    break;
+                case 'b':
+                    out.push_back('\b');
+                    break;
+                case 'f':
+                    out.push_back('\f');
+                    break;
+                case 'n':
+                    out.push_back('\n');
+                    break;
+                case 'r':
+                    out.push_back('\r');
+                    break;
+                case 't':
+                    out.push_back('\t');
+                    break;
+                case 'u':
+                    AppendUtf8(out, ParseCodePoint());
+                    break;
+                default:
+                    Fail("Invalid escape");
+            }
+        }
+    }
+
+    /**
+     * @brief Parses the code point of a `\u` escape, which takes a second
+     * escape for characters outside of the Basic Multilingual Plane. Unpaired
+     * surrogates are replaced with U+FFFD.
+     */
+    uint32_t ParseCodePoint() {
+        constexpr uint32_t kReplacement = 0xFFFD;
+        uint32_t code = ParseHex4();
+        if (code < 0xD800 || code > 0xDFFF) {
+            return code;
+        }
+        if (code > 0xDBFF || text_.substr(pos_, 2) != "\\u") {
+            return kReplacement;
+        }
+        size_t low_pos = pos_;
+        pos_ += 2;
+        uint32_t low = ParseHex4();
+        if (low < 0xDC00 || low > 0xDFFF) {
+            pos_ = low_pos;
+            return kReplacement;
+        }
+        return 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+    }
+
+    std::string_view text_;
+    size_t pos_ = 0;
+};
+
+/**
+ * @brief Gets the length of the UTF-8 sequence of a character starting at
+ * `pos`, or 0 if it is not a valid one.
+ */
+size_t GetSequenceLength(std::string_view text, size_t pos) {
+    auto lead = static_cast<unsigned char>(text[pos]);
+    if (lead < 0x80) {
+        return 1;
+    }
+    size_t length;
+    uint32_t code;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+        code = lead & 0x1F;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        code = lead & 0x0F;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        code = lead & 0x07;
+    } else {
+        return 0;
+    }
+    if (text.size() - pos < length) {
+        return 0;
+    }
+    for (size_t i = 1; i < length; ++i) {
+        auto c = static_cast<unsigned char>(text[pos + i]);
+        if ((c & 0xC0) != 0x80) {
+            return 0;
+        }
+        code = code << 6 | (c & 0x3F);
+    }
+    // Overlong encodings, surrogates and code points past U+10FFFF.
+    constexpr uint32_t kMinCode[] = {0, 0, 0x80, 0x800, 0x10000};
+    if (code < kMinCode[length] || (code >= 0xD800 && code <= 0xDFFF) ||
+        code > 0x10FFFF) {
+        return 0;
+    }
+    return length;
+}
+
+/**
+ * @brief Writes `text` as a JSON string. Bytes that are not valid UTF-8, e.g.
+ * of a character cut in an error message, are replaced with U+FFFD.
+ */
+void DumpString(std::string& out, std::string_view text) {
+    constexpr char kHex[] = "0123456789abcdef";
+    out.push_back('"');
+    for (size_t pos = 0; pos < text.size();) {
+        char c = text[pos];
+        switch (c) {
+            case '"':
+                out.append("\\\"");
+                break;
+            case '\\':
+                out.append("\\\\");
+                break;
+            case '\n':
+                out.append("\\n");
+                break;
+            case '\r':
+                out.append("\\r");
+                break;
+            case '\t':
+                out.append("\\t");
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    out.append("\\u00");
+                    out.push_back(kHex[c >> 4]);
+                    out.push_back(kHex[c & 0xF]);
+                } else if (size_t length = GetSequenceLength(text, pos)) {
+                    out.append(text, pos, length);
+                    pos += length;
+                    continue;
+                } else {
+                    out.append("\xEF\xBF\xBD");
+                }
+        }
+        ++pos;
+    }
+    out.push_back('"');
+}
+
+}  // namespace
+
+JsonValue JsonValue::Parse(std::string_view text) {
+    return JsonParser(text).ParseText();
+}
+
+bool JsonValue::IsNull() const {
+    return std::holds_alternative<std::nullptr_t>(value_);
+}
+
+bool JsonValue::IsString() const {
+    return std::holds_alternative<std::string>(value_);
+}
+
+bool JsonValue::IsArray() const {
+    return std::holds_alternative<Array>(value_);
+}
+
+bool JsonValue::GetBool() const {
+    if (const bool* value = std::get_if<bool>(&value_)) {
+        return *value;
+    }
+    throw JsonError("Expected a boolean.");
+}
+
+double JsonValue::GetNumber() const {
+    if (const double* value = std::get_if<double>(&value_)) {
+        return *value;
+    }
+    throw JsonError("Expected a number.");
+}
+
+const std::string& JsonValue::GetString() const {
+    if (const std::string* value = std::get_if<std::string>(&value_)) {
+        return *value;
+    }
+    throw JsonError("Expected a string.");
+}
+
+const JsonValue::Array& JsonValue::GetArray() const {
+    if (const Array* value = std::get_if<Array>(&value_)) {
+        return *value;
+    }
+    throw JsonError("Expected an array.");
+}
+
+const JsonValue::Object& JsonValue::GetObject() const {
+    if (const Object* value = std::get_if<Object>(&value_)) {
+        return *value;
+    }
+    throw JsonError("Expected an object.");
+}
+
+size_t JsonValue::GetIndex() const {
+    double value = GetNumber();
+    // Doubles hold integers exactly up to 2^53.
+    if (value < 0 || value > 0x1p53 || std::floor(value) != value) {
+        throw JsonError("Expected a non-negative integer.");
+    }
+    return static_cast<size_t>(value);
+}
+
+const JsonValue& JsonValue::operator[](std::string_view key) const {
+    static const JsonValue kNull;
+    if (const Object* object = std::get_if<Object>(&value_)) {
+        for (const auto& [name, value] : *object) {
+            if (name == key) {
+                return value;
+            }
+        }
+    }
+    return kNull;
+}
+
+std::string JsonValue::Dump() const {
+    std::string out;
+    DumpTo(out);
+    return out;
+}
+
+void JsonValue::DumpTo(std::string& out) const {
+    if (IsNull()) {
+        out.append("null");
+    } else if (const bool* value = std::get_if<bool>(&value_)) {
+        out.append(*value ? "true" : "false");
+    } else if (const double* value = std::get_if<double>(&value_)) {
+        char buffer[32];
+        char* end;
+        if (!std::isfinite(*value)) {
+            // As in JavaScript, there being no such numbers in JSON.
+            out.append("null");
+            return;
+        }
+        // Integers, e.g. ids and positions, are written without a fraction.
+        if (std::floor(*value) == *value && std::abs(*value) <= 0x1p53) {
+            end = std::to_chars(buffer, buffer + sizeof(buffer),
+                                static_cast<int64_t>(*value))
+                      .ptr;
+        } else {
+            end = std::to_chars(buffer, buffer + sizeof(buffer), *value).ptr;
+        }
+        out.append(buffer, end);
+    } else if (const std::string* value = std::get_if<std::string>(&value_)) {
+        DumpString(out, *value);
+    } else if (const Array* value = std::get_if<Array>(&value_)) {
+        out.push_back('[');
+        for (size_t i = 0; i < value->size(); ++i) {
+            if (i > 0) {
+                out.push_back(',');
+            }
+            (*value)[i].DumpTo(out);
+        }
+        out.push_back(']');
+    } else {
+        out.push_back('{');
+        const Object& object = std::get<Object>(value_);
+        for (size_t i = 0; i < object.size(); ++i) {
+            if (i > 0) {
+                out.push_back(',');
+            }
+            DumpString(out, object[i].first);
+            out.push_back(':');
+            object[i].second.DumpTo(out);
+        }
+        out.push_back('}');
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+/**
+ * @class JsonError
+ * @brief Thrown for texts that are not valid JSON and for values of another
+ * type than expected.
+ */
+class JsonError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/**
+ * @class JsonValue
+ * @brief JSON value, as exchanged with language server clients.
+ *
+ * Numbers are kept as doubles. Objects keep their members in order and are
+ * searched linearly, which suits the small objects of the protocol.
+ */
+class JsonValue {
+public:
+    using Array = std::vector<JsonValue>;
+    using Object = std::vector<std::pair<std::string, JsonValue>>;
+
+    /**
+     * @brief Constructs a null.
+     */
+    JsonValue() = default;
+
+    JsonValue(bool value) : value_(value) {
+    }
+
+    template <class T>
+        requires std::is_arithmetic_v<T>
+    JsonValue(T value) : value_(static_cast<double>(value)) {
+    }
+
+    JsonValue(const char* value) : value_(std::string(value)) {
+    }
+
+    JsonValue(std::string value) : value_(std::move(value)) {
+    }
+
+    JsonValue(Array value) : value_(std::move(value)) {
+    }
+
+    JsonValue(Object value) : value_(std::move(value)) {
+    }
+
+    /**
+     * @brief Parses `text`, which has to hold exactly one value.
+     *
+     * @throws Throws `JsonError` if it is not valid JSON.
+     */
+    static JsonValue Parse(std::string_view text);
+
+    bool IsNull() const;
+    bool IsString() const;
+    bool IsArray() const;
+
+    /**
+     * @brief Getters of the value as each of the types.
+     *
+     * @throws Throw `JsonError` if the value is of another type.
+     */
+    bool GetBool() const;
+    double GetNumber() const;
+    const std::string& GetString() const;
+    const Array& GetArray() const;
+    const Object& GetObject() const;
+
+    /**
+     * @brief Gets the number as a non-negative integer.
+     *
+     * @throws Throws `JsonError` if the value is not one.
+     */
+    size_t GetIndex() const;
+
+    /**
+     * @brief Gets the member `key` of an object, or a null if the value is not
+     * an object or has no such member, so that lookups can be chained.
+     */
+    const JsonValue& operator[](std::string_view key) const;
+
+    /**
+     * @brief Serializes the value without any whitespace.
+     */
+    std::string Dump() const;
+
+private:
+    void DumpTo(std::string& out) const;
+
+    std::variant<std::nullptr_t, bool, double, std::string, Array, Object>
+        value_ = nullptr;
+};
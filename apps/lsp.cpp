@@ -0,0 +1,589 @@
+#include "lsp.h"
+
+#include "json.h"
+
+#include <parser/formatter.h>
+#include <parser/incremental.h>
+#include <parser/parser.h>
+#include <parser/tokenizer.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cctype>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Error codes of JSON-RPC and the protocol.
+constexpr int kParseError = -32700;
+constexpr int kInvalidRequest = -32600;
+constexpr int kMethodNotFound = -32601;
+constexpr int kInvalidParams = -32602;
+constexpr int kServerNotInitialized = -32002;
+constexpr int kRequestFailed = -32803;
+
+constexpr int kSyncIncremental = 2;
+constexpr int kSeverityError = 1;
+constexpr int kMessageTypeError = 1;
+
+/**
+ * @enum class PositionEncoding
+ * @brief What the characters of positions count: bytes of UTF-8 or, by
+ * default, UTF-16 code units.
+ */
+enum class PositionEncoding { UTF8, UTF16 };
+
+bool IsContinuationByte(char c) {
+    return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+}
+
+/**
+ * @brief Counts the characters of `text` in `encoding`.
+ */
+size_t CountCharacters(std::string_view text, PositionEncoding encoding) {
+    if (encoding == PositionEncoding::UTF8) {
+        return text.size();
+    }
+    size_t units = 0;
+    for (char c : text) {
+        if (!IsContinuationByte(c)) {
+            // Characters of four bytes take a surrogate pair.
+            units += static_cast<unsigned char>(c) >= 0xF0 ? 2 : 1;
+        }
+    }
+    return units;
+}
+
+/**
+ * @brief Gets the number of bytes of the first `characters` characters of
+ * `text` in `encoding`, or its size if it is shorter.
+ */
+size_t SkipCharacters(std::string_view text, size_t characters,
+                      PositionEncoding encoding) {
+    if (encoding == PositionEncoding::UTF8) {
+        return std::min(characters, text.size());
+    }
+    size_t pos = 0;
+    for (size_t units = 0; pos < text.size() && units < characters;) {
+        auto lead = static_cast<unsigned char>(text[pos]);
+        size_t length = lead < 0xC0 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+        units += length == 4 ? 2 : 1;
+        pos = std::min(pos + length, text.size());
+    }
+    return pos;
+}
+
+/**
+ * @brief Gets the offsets of the lines of `text` after the first one, shifted
+ * by `base`.
+ */
+std::vector<size_t> IndexLines(std::string_view text, size_t base) {
+    std::vector<size_t> starts;
+    for (size_t pos = text.find('\n'); pos != std::string_view::npos;
+         pos = text.find('\n', pos + 1)) {
+        starts.push_back(base + pos + 1);
+    }
+    return starts;
+}
+
+/**
+ * @struct Document
+ * @brief Text document open in the client: its parser, which keeps the text,
+ * where its lines start and the diagnostics published last.
+ */
+struct Document {
+    Document(std::string text, size_t spaces_per_tab)
+        : parser_(std::move(text), spaces_per_tab) {
+        line_starts_ = IndexLines(parser_.GetText(), 0);
+        line_starts_.insert(line_starts_.begin(), 0);
+    }
+
+    IncrementalParser parser_;
+    std::vector<size_t> line_starts_;
+    std::string diagnostics_;  // as sent, empty if none were
+};
+
+/**
+ * @brief Replaces the bytes `[begin, end)` of `document` with `text`.
+ */
+void EditDocument(Document& document, size_t begin, size_t end,
+                  std::string_view text) {
+    document.parser_.Edit(begin, end - begin, text);
+    // The lines starting in the replaced bytes make way for those starting in
+    // `text`, and the ones after are shifted.
+    std::vector<size_t>& starts = document.line_starts_;
+    auto first = std::upper_bound(starts.begin(), starts.end(), begin);
+    auto last = std::upper_bound(first, starts.end(), end);
+    for (auto it = last; it != starts.end(); ++it) {
+        *it = *it - (end - begin) + text.size();
+    }
+    std::vector<size_t> inserted = IndexLines(text, begin);
+    starts.insert(starts.erase(first, last), inserted.begin(), inserted.end());
+}
+
+/**
+ * @brief Gets the offset in `document` of the protocol's `position`. Positions
+ * past the end of a line or of the text are moved back to it.
+ */
+size_t ToOffset(const Document& document, const JsonValue& position,
+                PositionEncoding encoding) {
+    std::string_view text = document.parser_.GetText();
+    const std::vector<size_t>& starts = document.line_starts_;
+    size_t line = position["line"].GetIndex();
+    if (line >= starts.size()) {
+        return text.size();
+    }
+    size_t begin = starts[line];
+    size_t end = line + 1 < starts.size() ? starts[line + 1] - 1 : text.size();
+    return begin + SkipCharacters(text.substr(begin, end - begin),
+                                  position["character"].GetIndex(), encoding);
+}
+
+/**
+ * @brief Gets the protocol's position of the `offset` in `document`.
+ */
+JsonValue ToPosition(const Document& document, size_t offset,
+                     PositionEncoding encoding) {
+    const std::vector<size_t>& starts = document.line_starts_;
+    size_t line =
+        std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin();
+    size_t begin = starts[line - 1];
+    std::string_view text = document.parser_.GetText();
+    return JsonValue::Object{
+        {"line", line - 1},
+        {"character",
+         CountCharacters(text.substr(begin, offset - begin), encoding)}};
+}
+
+JsonValue ToRange(const Document& document, size_t begin, size_t end,
+                  PositionEncoding encoding) {
+    return JsonValue::Object{{"start", ToPosition(document, begin, encoding)},
+                             {"end", ToPosition(document, end, encoding)}};
+}
+
+/**
+ * @brief Gets the diagnostic of an error at `coords`, line and column in
+ * bytes counted from 1, spanning the character there.
+ */
+JsonValue MakeDiagnostic(const Document& document,
+                         std::pair<size_t, size_t> coords,
+                         const std::string& message,
+                         PositionEncoding encoding) {
+    std::string_view text = document.parser_.GetText();
+    const std::vector<size_t>& starts = document.line_starts_;
+    size_t line = std::clamp<size_t>(coords.first, 1, starts.size()) - 1;
+    size_t line_end =
+        line + 1 < starts.size() ? starts[line + 1] - 1 : text.size();
+    size_t begin = std::min(starts[line] + coords.second - 1, line_end);
+    size_t end = begin;
+    if (end < line_end) {
+        ++end;
+        while (end < line_end && IsContinuationByte(text[end])) {
+            ++end;
+        }
+    }
+    return JsonValue::Object{
+        {"range", ToRange(document, begin, end, encoding)},
+        {"severity", kSeverityError},
+        {"source", "beautify"},
+        {"message", message}};
+}
+
+/**
+ * @class LanguageServer
+ * @brief State of `RunLanguageServer`: the open documents and where the
+ * protocol's lifecycle is.
+ */
+class LanguageServer {
+public:
+    LanguageServer(std::istream& in, std::ostream& out, const Options& options)
+        : in_(in), out_(out), spaces_per_tab_(options.spaces_) {
+    }
+
+    int Run();
+
+private:
+    /**
+     * @brief Reads the content of the next message.
+     *
+     * @return Returns nothing once the input ends.
+     */
+    std::optional<std::string> Read();
+
+    void Send(const JsonValue& message);
+    void Respond(const JsonValue& id, JsonValue result);
+    void RespondError(const JsonValue& id, int code, const std::string& msg);
+    void Notify(const std::string& method, JsonValue params);
+
+    void Handle(const JsonValue& message);
+    void HandleNotification(const std::string& method,
+                            const JsonValue& params);
+
+    JsonValue Initialize(const JsonValue& params);
+    void DidOpen(const JsonValue& params);
+    void DidChange(const JsonValue& params);
+    void DidClose(const JsonValue& params);
+    JsonValue Format(const JsonValue& params);
+    JsonValue FormatRange(const JsonValue& params);
+
+    /**
+     * @brief Gets the open document `params` refer to.
+     *
+     * @throws Throws `JsonError` if there is none.
+     */
+    Document& GetDocument(const JsonValue& params);
+
+    /**
+     * @brief Parses what changed in `document` and publishes its error, or
+     * that it has none, unless that is what was published last.
+     */
+    void PublishDiagnostics(const std::string& uri, Document& document);
+
+    /**
+     * @brief Gets the protocol's edits replacing the bytes `[begin, end)` of
+     * `document` with `text`: none if they are equal, and otherwise a single
+     * one leaving out the bytes they begin and end with alike.
+     */
+    JsonValue MakeEdits(const Document& document, size_t begin, size_t end,
+                        std::string_view text) const;
+
+    std::istream& in_;
+    std::ostream& out_;
+    size_t spaces_per_tab_;
+    PositionEncoding encoding_ = PositionEncoding::UTF16;
+    bool initialized_ = false;
+    bool shut_down_ = false;
+    std::optional<int> exit_code_;
+    std::unordered_map<std::string, std::unique_ptr<Document>> documents_;
+};
+
+int LanguageServer::Run() {
+    while (std::optional<std::string> content = Read()) {
+        JsonValue message;
+        try {
+            message = JsonValue::Parse(*content);
+        } catch (const JsonError& e) {
+            RespondError(JsonValue(), kParseError, e.what());
+            continue;
+        }
+        Handle(message);
+        if (exit_code_) {
+            return *exit_code_;
+        }
+    }
+    // The client went away without saying `exit`.
+    return shut_down_ ? 0 : 1;
+}
+
+std::optional<std::string> LanguageServer::Read() {
+    std::optional<size_t> length;
+    std::string line;
+    while (true) {
+        if (!std::getline(in_, line)) {
+            return std::nullopt;
+        }
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            if (length) {
+                break;
+            }
+            continue;
+        }
+        size_t colon = line.find(':');
+        std::string name = line.substr(0, colon);
+        std::transform(name.begin(), name.end(), name.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+        if (colon == std::string::npos || name != "content-length") {
+            continue;
+        }
+        size_t begin = line.find_first_not_of(' ', colon + 1);
+        begin = begin == std::string::npos ? line.size() : begin;
+        size_t value;
+        const char* end = line.data() + line.size();
+        auto [ptr, error] = std::from_chars(line.data() + begin, end, value);
+        if (error == std::errc()) {
+            length = value;
+        }
+    }
+    std::string content(*length, '\0');
+    if (!in_.read(content.data(), static_cast<std::streamsize>(*length))) {
+        return std::nullopt;
+    }
+    return content;
+}
+
+void LanguageServer::Send(const JsonValue& message) {
+    std::string content = message.Dump();
+    out_ << "Content-Length: " << content.size() << "\r\n\r\n" << content;
+    out_.flush();
+}
+
+void LanguageServer::Respond(const JsonValue& id, JsonValue result) {
+    Send(JsonValue::Object{
+        {"jsonrpc", "2.0"}, {"id", id}, {"result", std::move(result)}});
+}
+
+void LanguageServer::RespondError(const JsonValue& id, int code,
+                                  const std::string& msg) {
+    JsonValue error = JsonValue::Object{{"code", code}, {"message", msg}};
+    Send(JsonValue::Object{
+        {"jsonrpc", "2.0"}, {"id", id}, {"error", std::move(error)}});
+}
+
+void LanguageServer::Notify(const std::string& method, JsonValue params) {
+    Send(JsonValue::Object{
+        {"jsonrpc", "2.0"}, {"method", method}, {"params", std::move(params)}});
+}
+
+void LanguageServer::Handle(const JsonValue& message) {
+    const JsonValue& id = message["id"];
+    const JsonValue& method = message["method"];
+    if (!method.IsString()) {
+        // Responses to requests of the server, which sends none.
+        if (!message["error"].IsNull() || !message["result"].IsNull()) {
+            return;
+        }
+        RespondError(id, kInvalidRequest, "The message has no method.");
+        return;
+    }
+    const std::string& name = method.GetString();
+    const JsonValue& params = message["params"];
+    if (name == "exit") {
+        exit_code_ = shut_down_ ? 0 : 1;
+        return;
+    }
+    if (id.IsNull()) {
+        HandleNotification(name, params);
+        return;
+    }
+    if (!initialized_ && name != "initialize") {
+        RespondError(id, kServerNotInitialized,
+                     "The server is not initialized yet.");
+        return;
+    }
+    if (shut_down_) {
+        RespondError(id, kInvalidRequest, "The server is shutting down.");
+        return;
+    }
+    try {
+        if (name == "initialize") {
+            Respond(id, Initialize(params));
+        } else if (name == "shutdown") {
+            shut_down_ = true;
+            Respond(id, JsonValue());
+        } else if (name == "textDocument/formatting") {
+            Respond(id, Format(params));
+        } else if (name == "textDocument/rangeFormatting") {
+            Respond(id, FormatRange(params));
+        } else {
+            RespondError(id, kMethodNotFound,
+                         "Unknown method `" + name + "`.");
+        }
+    } catch (const JsonError& e) {
+        RespondError(id, kInvalidParams, e.what());
+    } catch (const TokenizerError& e) {
+        RespondError(id, kRequestFailed,
+                     std::string("TokenizerError: ") + e.what());
+    } catch (const ParserError& e) {
+        RespondError(id, kRequestFailed,
+                     std::string("ParserError: ") + e.what());
+    } catch (const std::exception& e) {
+        RespondError(id, kRequestFailed,
+                     std::string("Unknown error encountered: ") + e.what());
+    }
+}
+
+void LanguageServer::HandleNotification(const std::string& method,
+                                        const JsonValue& params) {
+    if (!initialized_ || shut_down_) {
+        return;
+    }
+    // Notifications get no reply, so errors are only logged by the client.
+    try {
+        if (method == "textDocument/didOpen") {
+            DidOpen(params);
+        } else if (method == "textDocument/didChange") {
+            DidChange(params);
+        } else if (method == "textDocument/didClose") {
+            DidClose(params);
+        }
+    } catch (const std::exception& e) {
+        Notify("window/logMessage",
+               JsonValue::Object{{"type", kMessageTypeError},
+                                 {"message", method + ": " + e.what()}});
+    }
+}
+
+JsonValue LanguageServer::Initialize(const JsonValue& params) {
+    // Positions in UTF-8 need no conversion, so they are preferred.
+    const JsonValue& encodings =
+        params["capabilities"]["general"]["positionEncodings"];
+    if (encodings.IsArray()) {
+        for (const JsonValue& encoding : encodings.GetArray()) {
+            if (encoding.IsString() && encoding.GetString() == "utf-8") {
+                encoding_ = PositionEncoding::UTF8;
+            }
+        }
+    }
+    initialized_ = true;
+    JsonValue sync = JsonValue::Object{{"openClose", true},
+                                       {"change", kSyncIncremental}};
+    JsonValue capabilities = JsonValue::Object{
+        {"positionEncoding",
+         encoding_ == PositionEncoding::UTF8 ? "utf-8" : "utf-16"},
+        {"textDocumentSync", std::move(sync)},
+        {"documentFormattingProvider", true},
+        {"documentRangeFormattingProvider", true}};
+    return JsonValue::Object{
+        {"capabilities", std::move(capabilities)},
+        {"serverInfo", JsonValue::Object{{"name", "beautify"}}}};
+}
+
+void LanguageServer::DidOpen(const JsonValue& params) {
+    const JsonValue& item = params["textDocument"];
+    const std::string& uri = item["uri"].GetString();
+    auto& document = documents_[uri];
+    document =
+        std::make_unique<Document>(item["text"].GetString(), spaces_per_tab_);
+    PublishDiagnostics(uri, *document);
+}
+
+void LanguageServer::DidChange(const JsonValue& params) {
+    Document& document = GetDocument(params);
+    for (const JsonValue& change : params["contentChanges"].GetArray()) {
+        const std::string& text = change["text"].GetString();
+        const JsonValue& range = change["range"];
+        if (range.IsNull()) {
+            EditDocument(document, 0, document.parser_.GetText().size(), text);
+            continue;
+        }
+        size_t begin = ToOffset(document, range["start"], encoding_);
+        size_t end = ToOffset(document, range["end"], encoding_);
+        if (end < begin) {
+            throw JsonError("The range ends before it starts.");
+        }
+        EditDocument(document, begin, end, text);
+    }
+    PublishDiagnostics(params["textDocument"]["uri"].GetString(), document);
+}
+
+void LanguageServer::DidClose(const JsonValue& params) {
+    const std::string& uri = params["textDocument"]["uri"].GetString();
+    if (documents_.erase(uri) > 0) {
+        Notify("textDocument/publishDiagnostics",
+               JsonValue::Object{{"uri", uri},
+                                 {"diagnostics", JsonValue::Array()}});
+    }
+}
+
+JsonValue LanguageServer::Format(const JsonValue& params) {
+    Document& document = GetDocument(params);
+    const Module& module = document.parser_.Parse();
+    StringSink sink;
+    CodeGenerator gen(sink);
+    gen.Generate(module);
+    return MakeEdits(document, 0, document.parser_.GetText().size(),
+                     sink.View());
+}
+
+JsonValue LanguageServer::FormatRange(const JsonValue& params) {
+    Document& document = GetDocument(params);
+    const JsonValue& range = params["range"];
+    size_t first_line = range["start"]["line"].GetIndex() + 1;
+    size_t last_line = range["end"]["line"].GetIndex() + 1;
+    // A range ending at the start of a line, as whole lines selected do, does
+    // not take that line in.
+    if (last_line > first_line && range["end"]["character"].GetIndex() == 0) {
+        --last_line;
+    }
+    TextEdit edit = FormatLines(document.parser_.GetText(), spaces_per_tab_,
+                                first_line, last_line);
+    return MakeEdits(document, edit.offset_, edit.offset_ + edit.length_,
+                     edit.text_);
+}
+
+Document& LanguageServer::GetDocument(const JsonValue& params) {
+    const std::string& uri = params["textDocument"]["uri"].GetString();
+    auto it = documents_.find(uri);
+    if (it == documents_.end()) {
+        throw JsonError("The document `" + uri + "` is not open.");
+    }
+    return *it->second;
+}
+
+void LanguageServer::PublishDiagnostics(const std::string& uri,
+                                        Document& document) {
+    JsonValue::Array diagnostics;
+    try {
+        document.parser_.Parse();
+    } catch (const TokenizerError& e) {
+        diagnostics.push_back(
+            MakeDiagnostic(document, e.GetCoords(),
+                           "TokenizerError: " + e.GetDescription(), encoding_));
+    } catch (const ParserError& e) {
+        diagnostics.push_back(
+            MakeDiagnostic(document, e.GetCoords(),
+                           "ParserError: " + e.GetDescription(), encoding_));
+    } catch (const std::exception& e) {
+        diagnostics.push_back(MakeDiagnostic(
+            document, {1, 1}, std::string("Unknown error encountered: ") +
+                                  e.what(), encoding_));
+    }
+    JsonValue list(std::move(diagnostics));
+    std::string dumped = list.Dump();
+    if (dumped == document.diagnostics_) {
+        return;
+    }
+    document.diagnostics_ = std::move(dumped);
+    Notify("textDocument/publishDiagnostics",
+           JsonValue::Object{{"uri", uri}, {"diagnostics", std::move(list)}});
+}
+
+JsonValue LanguageServer::MakeEdits(const Document& document, size_t begin,
+                                    size_t end, std::string_view text) const {
+    std::string_view old_text =
+        document.parser_.GetText().substr(begin, end - begin);
+    size_t common = std::min(old_text.size(), text.size());
+    size_t prefix = std::mismatch(old_text.begin(),
+                                  old_text.begin() + common, text.begin())
+                        .first -
+                    old_text.begin();
+    if (prefix == old_text.size() && prefix == text.size()) {
+        return JsonValue::Array();
+    }
+    size_t suffix = 0;
+    while (suffix < common - prefix &&
+           old_text[old_text.size() - 1 - suffix] ==
+               text[text.size() - 1 - suffix]) {
+        ++suffix;
+    }
+    // The edit starts and ends between characters.
+    while (prefix > 0 && prefix < old_text.size() &&
+           IsContinuationByte(old_text[prefix])) {
+        --prefix;
+    }
+    while (suffix > 0 &&
+           IsContinuationByte(old_text[old_text.size() - suffix])) {
+        --suffix;
+    }
+    std::string replacement(text.substr(prefix, text.size() - prefix - suffix));
+    JsonValue range = ToRange(document, begin + prefix,
+                              begin + old_text.size() - suffix, encoding_);
+    return JsonValue::Array{JsonValue::Object{
+        {"range", std::move(range)}, {"newText", std::move(replacement)}}};
+}
+
+}  // namespace
+
+int RunLanguageServer(std::istream& in, std::ostream& out,
+                      const Options& options) {
+    return LanguageServer(in, out, options).Run();
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "format.h"
+
+#include <istream>
+#include <ostream>
+
+/**
+ * @brief Serves editors as a language server, speaking the Language Server
+ * Protocol over `in` and `out`, until the client exits.
+ *
+ * Open documents are kept in memory, each with an `IncrementalParser`, and
+ * synchronized with incremental edits. Every change is parsed right away,
+ * reparsing only the top-level items it touches, and the tokenizer or parser
+ * error, if any, is published as a diagnostic. Whole documents are formatted
+ * from the module parsed last, ranges with `FormatLines`; either way the
+ * reply is a single edit spanning only what changes. Tabs are expanded as
+ * `options.spaces_` spaces.
+ *
+ * @return Returns the exit code: 0 if the client shut the server down before
+ * exiting, as it should, and 1 otherwise.
+ */
+int RunLanguageServer(std::istream& in, std::ostream& out,
+                      const Options& options);
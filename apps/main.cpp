@@ -1,34 +1,181 @@
-#include <parser/formatter.h>
-#include <parser/parser.h>
-#include <parser/tokenizer.h>
+#include "batch.h"
+#include "format.h"
+#include "lsp.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <cstring>
-#include <fstream>
+#include <filesystem>
 #include <iostream>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <utility>
 
 void usage() {
     std::cout << "Usage: ./beautify read_from [write_to] [OPTIONS]\n";
+    std::cout << "       ./beautify PATH... --output-dir DIR [OPTIONS]\n";
+    std::cout << "       ./beautify --lsp [OPTIONS]\n";
     std::cout << "\n";
     std::cout << "Description: this program accepts a file as input and "
                  "outputs the same file but formatted either to "
-                 "another file or stdout.\n";
+                 "another file or stdout. Given an output directory, it "
+                 "formats every file and directory listed into it instead.\n";
     std::cout << "\n";
     std::cout << "Options:\n";
     std::cout << "  --help                         Shows this message\n";
     std::cout << "  --spaces-per-tab -t            Specifies amount of spaces "
                  "a tab should be expanded as "
-                 "(defaults to 8)";
+                 "(defaults to 8)\n";
+    std::cout << "  --jobs -j                      Specifies amount of threads "
+                 "to use, 0 meaning one per core (defaults to 1, or one per "
+                 "core in batch mode)\n";
+    std::cout << "  --stream                       Formats the file one "
+                 "top-level declaration at a time to bound memory usage "
+                 "(always on for files over 4 GiB)\n";
+    std::cout << "  --check                        Only checks if the files "
+                 "listed are formatted already, writing nothing and exiting "
+                 "with 5 if any is not\n";
+    std::cout << "  --in-place -i                  Formats the files listed "
+                 "in place, rewriting only those that change\n";
+    std::cout << "  --diff                         Prints a unified diff of "
+                 "what formatting would change in the files listed, exiting "
+                 "with 5 if anything would\n";
+    std::cout << "  --lines A:B                    Formats only the "
+                 "declarations and imports overlapping lines A to B of a "
+                 "single file, leaving the rest of it as it is\n";
+    std::cout << "  --lsp                          Serves editors as a "
+                 "language server over stdin and stdout, formatting the "
+                 "documents they "
+                 "open and reporting their errors\n";
+    std::cout << "  --output-dir -o DIR            Formats in batch mode, "
+                 "writing every output to the same path under DIR\n";
+    std::cout << "  --files-from LIST              Also formats the files "
+                 "listed in LIST, one per line, \"-\" meaning stdin\n";
+    std::cout << "  --include GLOB                 Formats only files in "
+                 "directories matching GLOB, may be repeated\n";
+    std::cout << "  --exclude GLOB                 Skips files and "
+                 "directories matching GLOB, may be repeated\n";
+    std::cout << "  --readers N, --writers N       Specifies amount of threads "
+                 "reading and writing files in batch mode (defaults to 1)\n";
+    std::cout << "  --read-queue N                 Specifies how many files "
+                 "read ahead may wait to be formatted (defaults to 8)\n";
+    std::cout << "  --write-queue N                Specifies how many outputs "
+                 "may wait to be written (defaults to 8)\n";
+    std::cout << "  --stats                        Reports how busy the "
+                 "batch mode stages and queues were\n";
+    std::cout << "  --cache                        Keeps formatted files in a "
+                 "cache under ~/.cache/beautify to skip unchanged ones\n";
+    std::cout << "  --cache-dir DIR                Keeps the cache in DIR "
+                 "instead\n";
+    std::cout << "  --cache-size SIZE              Specifies the cache size "
+                 "limit in bytes, K, M or G (defaults to 256M)\n";
+    std::cout << "  --cache-eviction lru|fifo      Specifies whether the "
+                 "least recently used or the oldest cached files are removed "
+                 "first (defaults to lru)";
 }
 
-// Returns an object of structure {{input filename, output filename (stdout if
-// empty)}, spaces per tab}
-std::pair<std::pair<std::string, std::string>, size_t> ParseArgs(int argc,
-                                                                 char* argv[]) {
-    std::string in_filename;
-    std::string out_filename;
-    size_t spaces = 8;
+/**
+ * @brief Gets the value of the option at `argv[i]` and moves `i` past it.
+ */
+std::string TakeValue(int argc, char* argv[], int& i) {
+    if (i + 1 >= argc) {
+        std::cerr << "No value was provided for " << argv[i] << ".\n";
+        exit(1);
+    }
+    return argv[++i];
+}
+
+// Most threads any stage may be given.
+constexpr size_t kMaxThreads = 1024;
+
+/**
+ * @brief Gets the number, at most `max`, given to the option at `argv[i]`
+ * and moves `i` past it.
+ */
+size_t TakeCount(int argc, char* argv[], int& i,
+                 size_t max = SIZE_MAX) {
+    std::string option = argv[i];
+    std::string value = TakeValue(argc, argv, i);
+    try {
+        // Only digits, as `std::stoull` wraps negative numbers around.
+        if (value.empty() ||
+            value.find_first_not_of("0123456789") != std::string::npos) {
+            throw std::invalid_argument(value);
+        }
+        size_t count = std::stoull(value);
+        if (count > max) {
+            std::cerr << "Value for " << option << " is too large: " << value
+                      << ", at most " << max << " is allowed.\n";
+            exit(1);
+        }
+        return count;
+    } catch (const std::logic_error&) {
+        std::cerr << "Invalid value for " << option << ": " << value << ".\n";
+        exit(1);
+    }
+}
+
+/**
+ * @brief Gets the size in bytes given to the option at `argv[i]`, optionally
+ * suffixed with `K`, `M` or `G`, and moves `i` past it.
+ */
+uint64_t TakeSize(int argc, char* argv[], int& i) {
+    std::string option = argv[i];
+    std::string value = TakeValue(argc, argv, i);
+    try {
+        size_t end;
+        uint64_t size = std::stoull(value, &end);
+        std::string suffix = value.substr(end);
+        if (suffix == "K") {
+            size <<= 10;
+        } else if (suffix == "M") {
+            size <<= 20;
+        } else if (suffix == "G") {
+            size <<= 30;
+        } else if (!suffix.empty()) {
+            throw std::invalid_argument(suffix);
+        }
+        return size;
+    } catch (const std::logic_error&) {
+        std::cerr << "Invalid value for " << option << ": " << value << ".\n";
+        exit(1);
+    }
+}
+
+/**
+ * @brief Gets the range of lines `A:B` given to the option at `argv[i]`,
+ * counted from 1, and moves `i` past it.
+ */
+std::pair<size_t, size_t> TakeLines(int argc, char* argv[], int& i) {
+    std::string option = argv[i];
+    std::string value = TakeValue(argc, argv, i);
+    try {
+        constexpr const char* kDigits = "0123456789";
+        size_t colon = value.find(':');
+        if (colon == std::string::npos ||
+            value.find_first_not_of(kDigits) != colon ||
+            value.find_first_not_of(kDigits, colon + 1) != std::string::npos) {
+            throw std::invalid_argument(value);
+        }
+        size_t first = std::stoull(value.substr(0, colon));
+        size_t last = std::stoull(value.substr(colon + 1));
+        if (first == 0 || first > last) {
+            throw std::invalid_argument(value);
+        }
+        return {first, last};
+    } catch (const std::logic_error&) {
+        std::cerr << "Invalid value for " << option << ": " << value << ".\n";
+        exit(1);
+    }
+}
+
+Options ParseArgs(int argc, char* argv[]) {
+    Options options;
+    bool jobs_given = false;
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
         if (arg == "--help") {
@@ -37,7 +184,7 @@ std::pair<std::pair<std::string, std::string>, size_t> ParseArgs(int argc,
         } else if (arg == "--spaces-per-tab" || arg == "-t") {
             if (i + 1 < argc) {
                 try {
-                    spaces = std::stoull(argv[i + 1]);
+                    options.spaces_ = std::stoull(argv[i + 1]);
                 } catch (const std::invalid_argument&) {
                     std::cerr << "Invalid value for spaces per tab argument: "
                               << argv[i + 1] << ".\n";
@@ -48,56 +195,163 @@ std::pair<std::pair<std::string, std::string>, size_t> ParseArgs(int argc,
                 std::cerr << "No spaces per tab argument value was provided.\n";
                 exit(1);
             }
-        } else if (in_filename.empty()) {
-            in_filename = arg;
-        } else if (out_filename.empty()) {
-            out_filename = arg;
+        } else if (arg == "--jobs" || arg == "-j") {
+            options.jobs_ = TakeCount(argc, argv, i, kMaxThreads);
+            jobs_given = true;
+        } else if (arg == "--stream") {
+            options.stream_ = true;
+        } else if (arg == "--check") {
+            options.check_ = true;
+        } else if (arg == "--in-place" || arg == "-i") {
+            options.in_place_ = true;
+        } else if (arg == "--diff") {
+            options.diff_ = true;
+        } else if (arg == "--lines") {
+            std::tie(options.first_line_, options.last_line_) =
+                TakeLines(argc, argv, i);
+        } else if (arg == "--lsp") {
+            options.lsp_ = true;
+        } else if (arg == "--output-dir" || arg == "-o") {
+            options.output_dir_ = TakeValue(argc, argv, i);
+        } else if (arg == "--files-from") {
+            options.files_from_ = TakeValue(argc, argv, i);
+        } else if (arg == "--include") {
+            options.includes_.push_back(TakeValue(argc, argv, i));
+        } else if (arg == "--exclude") {
+            options.excludes_.push_back(TakeValue(argc, argv, i));
+        } else if (arg == "--readers") {
+            options.readers_ = TakeCount(argc, argv, i, kMaxThreads);
+        } else if (arg == "--writers") {
+            options.writers_ = TakeCount(argc, argv, i, kMaxThreads);
+        } else if (arg == "--read-queue") {
+            options.read_queue_ = TakeCount(argc, argv, i);
+        } else if (arg == "--write-queue") {
+            options.write_queue_ = TakeCount(argc, argv, i);
+        } else if (arg == "--stats") {
+            options.stats_ = true;
+        } else if (arg == "--cache") {
+            options.cache_dir_ = FormatCache::DefaultDirectory().string();
+        } else if (arg == "--cache-dir") {
+            options.cache_dir_ = TakeValue(argc, argv, i);
+        } else if (arg == "--cache-size") {
+            options.cache_size_ = TakeSize(argc, argv, i);
+        } else if (arg == "--cache-eviction") {
+            std::string value = TakeValue(argc, argv, i);
+            if (value == "lru") {
+                options.cache_eviction_ = CacheEviction::LRU;
+            } else if (value == "fifo") {
+                options.cache_eviction_ = CacheEviction::FIFO;
+            } else {
+                std::cerr << "Invalid value for --cache-eviction: " << value
+                          << ".\n";
+                exit(1);
+            }
         } else {
-            std::cerr << "Unknown argument: " << arg << ".\n";
+            options.paths_.push_back(arg);
+        }
+    }
+    int modes = options.check_ + options.diff_ + options.in_place_ +
+                !options.output_dir_.empty();
+    if (modes > 1) {
+        std::cerr << "Only one of --check, --diff, --in-place and "
+                     "--output-dir can be given.\n";
+        exit(1);
+    }
+    if (options.lsp_) {
+        // Documents come from the client instead.
+        if (modes > 0 || options.stream_ || options.first_line_ != 0 ||
+            !options.paths_.empty() || !options.files_from_.empty()) {
+            std::cerr << "--lsp can be given with no input files and no "
+                         "other mode.\n";
             exit(1);
         }
+        return options;
+    }
+    // Checking, diffing and formatting in place write no separate output, so
+    // every path given is an input.
+    bool inputs_only = options.check_ || options.diff_ || options.in_place_;
+    if (!options.files_from_.empty() && options.output_dir_.empty() &&
+        !inputs_only) {
+        std::cerr << "No output directory was provided.\n";
+        exit(1);
     }
-    if (in_filename.empty()) {
+    if (options.paths_.empty() && options.files_from_.empty()) {
         std::cerr << "No input filename was provided.\n";
         exit(1);
     }
-    return {{in_filename, out_filename}, spaces};
+    std::error_code error;
+    options.batch_ =
+        !options.output_dir_.empty() || !options.files_from_.empty() ||
+        (inputs_only &&
+         (options.paths_.size() != 1 ||
+          std::filesystem::is_directory(options.paths_[0], error)));
+    if (options.batch_ && options.first_line_ != 0) {
+        std::cerr << "--lines can only be given with a single input file.\n";
+        exit(1);
+    }
+    if (options.batch_) {
+        if (!jobs_given) {
+            options.jobs_ = 0;
+        }
+    } else if (options.paths_.size() > 2) {
+        std::cerr << "Unknown argument: " << options.paths_[2] << ".\n";
+        exit(1);
+    } else {
+        options.in_filename_ = options.paths_[0];
+        if (options.paths_.size() == 2) {
+            options.out_filename_ = options.paths_[1];
+        }
+    }
+    if (options.jobs_ == 0) {
+        options.jobs_ = std::max(1u, std::thread::hardware_concurrency());
+    }
+    return options;
 }
 
 int main(int argc, char* argv[]) {
-    if (argc < 2 || argc > 4) {
+    if (argc < 2) {
         usage();
         return 0;
     }
-    auto [filenames, spaces] = ParseArgs(argc, argv);
-    auto& [in_filename, out_filename] = filenames;
-    std::ifstream in(in_filename);
-    if (in.fail()) {
-        std::cerr << "File `" << in_filename << "` does not exist.\n";
-        return 1;
+    Options options = ParseArgs(argc, argv);
+    if (options.lsp_) {
+        std::ios::sync_with_stdio(false);
+        return RunLanguageServer(std::cin, std::cout, options);
     }
-    Tokenizer tokenizer(&in, spaces);
-    Parser parser(tokenizer);
-    Module file;
-    try {
-        file = parser.ParseFile();
-    } catch (const TokenizerError& e) {
-        std::cerr << "TokenizerError: " << e.what() << std::endl;
-        exit(2);
-    } catch (const ParserError& e) {
-        std::cerr << "ParserError: " << e.what() << std::endl;
-        exit(3);
-    } catch (const std::exception& e) {
-        std::cerr << "Unknown error encountered: " << e.what() << std::endl;
-        exit(4);
-    }
-    if (out_filename.empty()) {
-        CodeGenerator gen(std::cout);
-        gen.Generate(file);
+    std::optional<FormatCache> cache;
+    if (!options.cache_dir_.empty()) {
+        cache.emplace(options.cache_dir_, options.cache_size_,
+                      options.cache_eviction_);
+    }
+    FormatCache* cache_ptr = cache ? &*cache : nullptr;
+    int code;
+    if (options.batch_) {
+        code = RunBatch(options, cache_ptr);
+    } else if (options.check_) {
+        FileReport report =
+            CheckFile(options.in_filename_, options, cache_ptr);
+        std::cerr << report.message_;
+        code = report.code_;
+    } else if (options.in_place_) {
+        FileReport report =
+            FormatInPlace(options.in_filename_, options, cache_ptr);
+        std::cerr << report.message_;
+        code = report.code_;
+    } else if (options.diff_) {
+        std::string diff;
+        FileReport report =
+            DiffFile(options.in_filename_, options, cache_ptr, diff);
+        std::cout << diff;
+        std::cerr << report.message_;
+        code = report.code_;
     } else {
-        std::ofstream out(out_filename);
-        CodeGenerator gen(out);
-        gen.Generate(file);
+        FileReport report = FormatFile(
+            options.in_filename_, options.out_filename_, options, cache_ptr);
+        std::cerr << report.message_;
+        code = report.code_;
+    }
+    if (cache) {
+        cache->Evict();
     }
-    return 0;
+    return code;
 }
@@ -0,0 +1,92 @@
+// Times `Tokenizer::Tokenize` for every thread count up to the number of
+// hardware threads over a generated source large enough for each of them to
+// get chunks of at least a mebibyte, the least the parallel path splits into.
+//
+// Usage: tokenize_bench [megabytes-per-thread] [max-threads] [runs]
+
+#include <parser/source.h>
+#include <parser/tokenizer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+namespace {
+
+constexpr size_t kMebibyte = 1 << 20;
+
+std::string GenerateSource(size_t size) {
+    static const char* const kNames[] = {"x", "foo", "bar_1", "Long_name2",
+                                         "_q"};
+    std::string text;
+    text.reserve(size + 256);
+    size_t i = 0;
+    while (text.size() < size) {
+        std::string index = std::to_string(i++);
+        text += "module m";
+        text += index;
+        text += " where\n    import ";
+        text += kNames[i % 5];
+        text += " as y (g)\n    let f";
+        text += index;
+        text += "(a, b) := (a + 24953) ^ -b / 80.5503 where\n";
+        text += "        let g := ";
+        text += kNames[(i + 1) % 5];
+        text += " * --b - f(a, 722.9861)\n";
+        text += "    let c := g(1, 2)  +-95719   \n\n";
+    }
+    return text;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t megabytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4;
+    size_t max_threads = argc > 2 ? std::strtoul(argv[2], nullptr, 10)
+                                  : std::thread::hardware_concurrency();
+    size_t runs = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 5;
+    max_threads = std::max<size_t>(max_threads, 1);
+    megabytes = std::max<size_t>(megabytes, 1);
+    runs = std::max<size_t>(runs, 1);
+
+    Source source =
+        Source::FromString(GenerateSource(megabytes * max_threads * kMebibyte));
+    std::printf("source: %zu bytes, best of %zu runs\n", source.Size(), runs);
+    std::printf("%8s %10s %10s %8s\n", "threads", "tokens", "ms", "speedup");
+
+    TokenBuffer expected;
+    double base = 0;
+    for (size_t threads = 1; threads <= max_threads; ++threads) {
+        double best = 0;
+        TokenBuffer buffer;
+        for (size_t run = 0; run < runs; ++run) {
+            Tokenizer tokenizer(source, 4);
+            auto start = std::chrono::steady_clock::now();
+            buffer = tokenizer.Tokenize(threads);
+            std::chrono::duration<double, std::milli> elapsed =
+                std::chrono::steady_clock::now() - start;
+            if (run == 0 || elapsed.count() < best) {
+                best = elapsed.count();
+            }
+        }
+        if (buffer.GetError()) {
+            std::fprintf(stderr, "%s\n", buffer.GetError()->what());
+            return 1;
+        }
+        if (threads == 1) {
+            expected = std::move(buffer);
+            base = best;
+        } else if (buffer != expected) {
+            std::fprintf(stderr, "%zu threads give other tokens\n", threads);
+            return 1;
+        }
+        std::printf("%8zu %10zu %10.1f %7.2fx\n", threads,
+                    threads == 1 ? expected.Size() : buffer.Size(), best,
+                    base / best);
+    }
+    return 0;
+}
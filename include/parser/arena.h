@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <utility>
+
+/**
+ * @class Arena
+ * @brief Monotonic memory resource owning the nodes of a parsed module.
+ *
+ * Allocation is a pointer bump and deallocation is a no-op: the memory is
+ * released all at once when the arena itself is destroyed.
+ */
+class Arena : public std::pmr::monotonic_buffer_resource {
+public:
+    Arena() : std::pmr::monotonic_buffer_resource(kInitialBlockSize) {
+    }
+
+private:
+    static constexpr size_t kInitialBlockSize = 64 * 1024;
+};
+
+/**
+ * @struct NodeDeleter
+ * @brief Destroys a heap node owned by a `NodePtr`. Node types forming deep
+ * trees specialize it to tear the tree down without recursion.
+ */
+template <class T>
+struct NodeDeleter {
+    void operator()(T* node) const {
+        delete node;
+    }
+};
+
+/**
+ * @class NodePtr
+ * @brief Owning pointer to an AST node that lives either on the heap or in an
+ * `Arena`.
+ *
+ * Heap nodes are destroyed like with `std::unique_ptr`. Arena nodes are never
+ * destroyed one by one, so everything such a node owns (strings, vectors,
+ * other nodes) has to be allocated from the same arena.
+ */
+template <class T>
+class NodePtr {
+public:
+    NodePtr() = default;
+
+    NodePtr(NodePtr&& other) noexcept
+        : ptr_(std::exchange(other.ptr_, nullptr)), owned_(other.owned_) {
+    }
+
+    NodePtr& operator=(NodePtr&& other) noexcept {
+        if (this != &other) {
+            Reset();
+            ptr_ = std::exchange(other.ptr_, nullptr);
+            owned_ = other.owned_;
+        }
+        return *this;
+    }
+
+    ~NodePtr() {
+        Reset();
+    }
+
+    T& operator*() const {
+        return *ptr_;
+    }
+
+    T* operator->() const {
+        return ptr_;
+    }
+
+    T* get() const {
+        return ptr_;
+    }
+
+    explicit operator bool() const {
+        return ptr_ != nullptr;
+    }
+
+    /**
+     * @brief Gives up a heap node, which the caller then has to destroy with
+     * `NodeDeleter`. Returns null for arena nodes, which are left in place.
+     */
+    T* ReleaseOwned() {
+        if (!owned_) {
+            return nullptr;
+        }
+        owned_ = false;
+        return std::exchange(ptr_, nullptr);
+    }
+
+private:
+    template <class U, class... Args>
+    friend NodePtr<U> MakeNode(Arena* arena, Args&&... args);
+
+    NodePtr(T* ptr, bool owned) : ptr_(ptr), owned_(owned) {
+    }
+
+    void Reset() {
+        if (owned_ && ptr_ != nullptr) {
+            NodeDeleter<T>()(ptr_);
+        }
+        ptr_ = nullptr;
+    }
+
+    T* ptr_ = nullptr;
+    bool owned_ = false;
+};
+
+/**
+ * @brief Creates a node in `arena`, or on the heap if `arena` is null.
+ */
+template <class T, class... Args>
+NodePtr<T> MakeNode(Arena* arena, Args&&... args) {
+    if (arena == nullptr) {
+        return NodePtr<T>(new T(std::forward<Args>(args)...), true);
+    }
+    void* memory = arena->allocate(sizeof(T), alignof(T));
+    return NodePtr<T>(new (memory) T(std::forward<Args>(args)...), false);
+}
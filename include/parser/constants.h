@@ -1,52 +1,114 @@
 #pragma once
 
-#include <string>
-#include <unordered_map>
+#include <array>
+#include <cstddef>
+#include <string_view>
 
 #include "parser.h"
 #include "tokenizer.h"
 
-inline const std::unordered_map<Operator, std::string> kOperatorRepr{
-    {Operator::ADD, "+"},
-    {Operator::SUB, "-"},
-    {Operator::MUL, "*"},
-    {Operator::DIV, "/"},
-    {Operator::POW, "^"}};
-
-inline const std::unordered_map<Operator, int> kOperatorPrecedence{
-    {Operator::ADD, 1},
-    {Operator::SUB, 1},
-    {Operator::MUL, 2},
-    {Operator::DIV, 2},
-    {Operator::POW, 3}};
-
-inline const std::unordered_map<std::string, Token> kStringToToken{
-    {"import", Token(TokenType::IMPORT, "import")},
-    {"let", Token(TokenType::LET, "let")},
-    {"as", Token(TokenType::AS, "as")},
-    {"where", Token(TokenType::WHERE, "where")},
-    {"module", Token(TokenType::MODULE, "module")}};
-
-inline const std::unordered_map<TokenType, std::string> kTokenName = {
-    {TokenType::IMPORT, "import"},
-    {TokenType::AS, "as"},
-    {TokenType::MODULE, "module"},
-    {TokenType::LET, "let"},
-    {TokenType::WHERE, "where"},
-    {TokenType::DOT, "dot"},
-    {TokenType::COMMA, "comma"},
-    {TokenType::L_BRACKET, "opening bracket"},
-    {TokenType::R_BRACKET, "closing bracket"},
-    {TokenType::ASSIGN, "assignment operator"},
-    {TokenType::INDENT, "indent"},
-    {TokenType::DEDENT, "dedent"},
-    {TokenType::EOL, "end of line"},
-    {TokenType::FILE_END, "end of file"},
-    {TokenType::ADD, "addition"},
-    {TokenType::SUB, "subtraction"},
-    {TokenType::MUL, "multiplication"},
-    {TokenType::DIV, "division"},
-    {TokenType::POW, "power"},
-    {TokenType::IDENTIFIER, "identifier"},
-    {TokenType::INTEGER, "integer"},
-    {TokenType::FLOAT, "float"}};
+inline constexpr size_t kOperatorCount =
+    static_cast<size_t>(Operator::ROOT) + 1;
+inline constexpr size_t kTokenTypeCount =
+    static_cast<size_t>(TokenType::NONE) + 1;
+
+/**
+ * @brief Representation of every operator, indexed by `Operator`.
+ */
+inline constexpr auto kOperatorRepr = [] {
+    std::array<std::string_view, kOperatorCount> repr{};
+    repr[static_cast<size_t>(Operator::ADD)] = "+";
+    repr[static_cast<size_t>(Operator::SUB)] = "-";
+    repr[static_cast<size_t>(Operator::MUL)] = "*";
+    repr[static_cast<size_t>(Operator::DIV)] = "/";
+    repr[static_cast<size_t>(Operator::POW)] = "^";
+    return repr;
+}();
+
+/**
+ * @brief Precedence of every operator, indexed by `Operator`. The root of an
+ * expression binds the weakest.
+ */
+inline constexpr auto kOperatorPrecedence = [] {
+    std::array<int, kOperatorCount> precedence{};
+    precedence[static_cast<size_t>(Operator::ADD)] = 1;
+    precedence[static_cast<size_t>(Operator::SUB)] = 1;
+    precedence[static_cast<size_t>(Operator::MUL)] = 2;
+    precedence[static_cast<size_t>(Operator::DIV)] = 2;
+    precedence[static_cast<size_t>(Operator::POW)] = 3;
+    precedence[static_cast<size_t>(Operator::ROOT)] = 0;
+    return precedence;
+}();
+
+/**
+ * @brief Human readable name of every token type, indexed by `TokenType`.
+ */
+inline constexpr auto kTokenName = [] {
+    std::array<std::string_view, kTokenTypeCount> names{};
+    names[static_cast<size_t>(TokenType::IMPORT)] = "import";
+    names[static_cast<size_t>(TokenType::AS)] = "as";
+    names[static_cast<size_t>(TokenType::MODULE)] = "module";
+    names[static_cast<size_t>(TokenType::LET)] = "let";
+    names[static_cast<size_t>(TokenType::WHERE)] = "where";
+    names[static_cast<size_t>(TokenType::DOT)] = "dot";
+    names[static_cast<size_t>(TokenType::COMMA)] = "comma";
+    names[static_cast<size_t>(TokenType::L_BRACKET)] = "opening bracket";
+    names[static_cast<size_t>(TokenType::R_BRACKET)] = "closing bracket";
+    names[static_cast<size_t>(TokenType::ASSIGN)] = "assignment operator";
+    names[static_cast<size_t>(TokenType::INDENT)] = "indent";
+    names[static_cast<size_t>(TokenType::DEDENT)] = "dedent";
+    names[static_cast<size_t>(TokenType::EOL)] = "end of line";
+    names[static_cast<size_t>(TokenType::FILE_END)] = "end of file";
+    names[static_cast<size_t>(TokenType::ADD)] = "addition";
+    names[static_cast<size_t>(TokenType::SUB)] = "subtraction";
+    names[static_cast<size_t>(TokenType::MUL)] = "multiplication";
+    names[static_cast<size_t>(TokenType::DIV)] = "division";
+    names[static_cast<size_t>(TokenType::POW)] = "power";
+    names[static_cast<size_t>(TokenType::IDENTIFIER)] = "identifier";
+    names[static_cast<size_t>(TokenType::INTEGER)] = "integer";
+    names[static_cast<size_t>(TokenType::FLOAT)] = "float";
+    return names;
+}();
+
+constexpr std::string_view OperatorRepr(Operator op) {
+    return kOperatorRepr[static_cast<size_t>(op)];
+}
+
+constexpr int OperatorPrecedence(Operator op) {
+    return kOperatorPrecedence[static_cast<size_t>(op)];
+}
+
+constexpr std::string_view TokenName(TokenType type) {
+    return kTokenName[static_cast<size_t>(type)];
+}
+
+/**
+ * @brief Maps a word to its keyword token type, or to `TokenType::IDENTIFIER`
+ * if the word is not a keyword.
+ *
+ * Keywords are told apart by length and first character, so a lookup costs at
+ * most one short comparison.
+ */
+constexpr TokenType LookupKeyword(std::string_view word) {
+    switch (word.size()) {
+        case 2:
+            return word == "as" ? TokenType::AS : TokenType::IDENTIFIER;
+        case 3:
+            return word == "let" ? TokenType::LET : TokenType::IDENTIFIER;
+        case 5:
+            return word == "where" ? TokenType::WHERE : TokenType::IDENTIFIER;
+        case 6:
+            if (word[0] == 'i') {
+                return word == "import" ? TokenType::IMPORT
+                                        : TokenType::IDENTIFIER;
+            }
+            return word == "module" ? TokenType::MODULE : TokenType::IDENTIFIER;
+        default:
+            return TokenType::IDENTIFIER;
+    }
+}
+
+static_assert(LookupKeyword("import") == TokenType::IMPORT);
+static_assert(LookupKeyword("module") == TokenType::MODULE);
+static_assert(LookupKeyword("modulo") == TokenType::IDENTIFIER);
+static_assert(OperatorRepr(Operator::POW) == "^");
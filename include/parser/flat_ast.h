@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "parser.h"
+
+/**
+ * @enum class NodeKind
+ * @brief Kind of a `FlatAst` node; one per alternative of `Expression`.
+ */
+enum class NodeKind : uint8_t {
+    UNARY_OPERATION,
+    BINARY_OPERATION,
+    FUNCTION_CALL,
+    VARIABLE,
+    NUMBER,
+    FLOAT
+};
+
+/**
+ * @class FlatAst
+ * @brief Alternative, index-based layout of expression trees, which `Parser`
+ * builds with `Allocation::FLAT`.
+ *
+ * Instead of a `std::variant` per node with children behind pointers, nodes
+ * are rows of parallel arrays addressed by 32-bit `NodeId`s: a kind, an
+ * operator and one 64-bit data word. The data word holds both children of an
+ * operation (`lhs | rhs << 32`), the only child of an unary operation, a
+ * variable's symbol or the value of a literal. For a function call it points
+ * to a block in a separate array (`first | argument count << 32`) holding the
+ * name's symbol followed by the argument ids. Names are symbols of the table of
+ * the module the expressions were parsed into. Children are always added
+ * before their parents, so whole-tree passes can run over the arrays front to
+ * back.
+ */
+class FlatAst {
+public:
+    /**
+     * @brief Adds a node whose children, if any, were added before and
+     * returns its id.
+     */
+    NodeId AddUnaryOperation(Operator op, NodeId operand);
+    NodeId AddBinaryOperation(NodeId lhs, Operator op, NodeId rhs);
+    NodeId AddFunctionCall(Symbol name, std::span<const NodeId> arguments);
+    NodeId AddVariable(Symbol name);
+    NodeId AddNumber(int64_t value);
+    NodeId AddFloat(double value);
+
+    size_t Size() const;
+
+    NodeKind GetKind(NodeId node) const;
+
+    /**
+     * @brief Gets operator of an unary or binary operation.
+     */
+    Operator GetOperator(NodeId node) const;
+
+    /**
+     * @brief Gets the operand of an unary operation or the left operand of a
+     * binary one.
+     */
+    NodeId GetLhs(NodeId node) const;
+
+    /**
+     * @brief Gets the right operand of a binary operation.
+     */
+    NodeId GetRhs(NodeId node) const;
+
+    /**
+     * @brief Gets name of a function call or a variable.
+     */
+    Symbol GetName(NodeId node) const;
+
+    /**
+     * @brief Gets number of arguments of a function call and the `index`-th of
+     * them.
+     */
+    size_t GetArgumentCount(NodeId node) const;
+    NodeId GetArgument(NodeId node, size_t index) const;
+
+    int64_t GetNumber(NodeId node) const;
+    double GetFloat(NodeId node) const;
+
+private:
+    NodeId AddNode(NodeKind kind, Operator op, uint64_t data);
+
+    std::vector<NodeKind> kinds_;
+    std::vector<Operator> operators_;
+    std::vector<uint64_t> data_;
+
+    std::vector<uint32_t> arguments_;
+};
@@ -1,32 +1,142 @@
-#include <ostream>
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
 #include <variant>
+#include <vector>
 
+#include "flat_ast.h"
 #include "parser.h"
+#include "sink.h"
 #include "tokenizer.h"
 
+/**
+ * @struct PreformattedFile
+ * @brief A file whose top-level declarations were parsed and generated by
+ * `PreformatFile`, with what is needed to put them together: all of its
+ * imports and whether any of its submodules is not empty (see
+ * `FileOutline`).
+ */
+struct PreformattedFile {
+    std::shared_ptr<SymbolTable> symbols_ = nullptr;
+    Imports imports_;
+    bool has_nonempty_submodule_ = false;
+
+    // Generated declarations in order, in blocks of adjacent ones: the block
+    // `texts_[i]` is split at the offsets `declaration_ends_[i]`.
+    std::vector<std::string> texts_;
+    std::vector<std::vector<size_t>> declaration_ends_;
+};
+
+/**
+ * @brief Smallest number of tokens worth a batch of its own in
+ * `PreformatFile`.
+ */
+constexpr size_t kMinBatchTokens = 1 << 16;
+
+/**
+ * @brief Parses the file tokenized into `tokens` and generates its top-level
+ * declarations on up to `threads` threads.
+ *
+ * The tokens are split into batches of at least `min_batch_tokens` tokens at
+ * lines starting with `import`, `let` or `module`, which are parsed and
+ * generated concurrently. A batch is only
+ * used if the file parsed from its beginning reaches an item exactly where
+ * the batch starts; otherwise the items in between are parsed again
+ * sequentially. The result is thus the same as the one of `Parser::ParseFile`,
+ * and so are the errors, which are thrown here.
+ */
+PreformattedFile PreformatFile(const TokenBuffer& tokens, size_t threads,
+                               size_t min_batch_tokens = kMinBatchTokens);
+
+/**
+ * @struct TextEdit
+ * @brief Replacement of the bytes `[offset_, offset_ + length_)` of a text
+ * with `text_`.
+ */
+struct TextEdit {
+    size_t offset_ = 0;
+    size_t length_ = 0;
+    std::string text_;
+};
+
+/**
+ * @brief Formats only the items (declarations and imports) of `text` that
+ * overlap its lines `[first_line, last_line]`, counted from 1, leaving every
+ * other byte as it is.
+ *
+ * The items formatted are those of the innermost block holding all of the
+ * non-blank lines, which is told apart by indentation alone. Only their lines
+ * are tokenized and parsed, starting in the indentation context of the block,
+ * and they are generated as many blocks deep as the block is nested and laid
+ * out as in the formatted file, except that imports are left where they are.
+ * If the block is not indented by two spaces per level, as the output is, the
+ * items of the enclosing block are formatted instead.
+ *
+ * @return Returns the edit replacing the items with their formatted text,
+ * which is empty if no item overlaps the lines.
+ *
+ * @throws Throws the tokenizer and parser errors of the formatted items.
+ */
+TextEdit FormatLines(std::string_view text, size_t spaces_per_tab,
+                     size_t first_line, size_t last_line);
+
 /**
  * @class CodeGenerator
  * @brief Converts AST-like structure to source code.
  *
  * Using a structure generated by `Parser` class outputs the source code that
- * the AST-like structure corresponds to to the specified stream.
+ * the AST-like structure corresponds to to the specified sink. The generator
+ * is instantiated for every sink in `sink.h`.
  */
+template <OutputSink Sink>
 class CodeGenerator {
 public:
     /**
-     * @brief Constucts `CodeGenerator` entity with the stream where the source
+     * @brief Constucts `CodeGenerator` entity with the sink where the source
      * code should be printed to.
      */
-    explicit CodeGenerator(std::ostream& out);
+    explicit CodeGenerator(Sink& out);
 
     /**
      * @brief Starts the generation.
      */
     void Generate(const Module& module);
 
+    /**
+     * @brief Parses `source` once more after `outline` was taken from it and
+     * generates it exactly as `Generate` would generate the parsed file, but
+     * keeps only one top-level declaration in memory at a time: each one is
+     * generated and freed right after it is parsed.
+     */
+    void GenerateStreaming(const Source& source, size_t spaces_per_tab,
+                           const FileOutline& outline);
+
+    /**
+     * @brief Puts together a file generated by `PreformatFile`, exactly as
+     * `Generate` would generate the parsed file.
+     */
+    void Generate(const PreformattedFile& file);
+
 private:
-    std::ostream& out_;
+    friend PreformattedFile PreformatFile(const TokenBuffer& tokens,
+                                          size_t threads,
+                                          size_t min_batch_tokens);
+    friend TextEdit FormatLines(std::string_view text, size_t spaces_per_tab,
+                                size_t first_line, size_t last_line);
+
+    Sink& out_;
     size_t indent_level_ = 0;
+    const SymbolTable* symbols_ = nullptr;
+    const FlatAst* flat_ = nullptr;  // of the module, if parsed flat
+
+    /**
+     * @brief Resolves a symbol of the module being generated.
+     */
+    std::string_view Name(Symbol symbol) const;
 
     /**
      * @brief Helper function to print `2 * indent_level_` spaces at the start
@@ -51,6 +161,7 @@ private:
 
     void GenerateModule(const Module& module);
     void GenerateImports(const Imports& imports);
+    void GenerateImport(const Import& import);
 
     /**
      * @struct DeclarationVisitor
@@ -84,16 +195,47 @@ private:
         void operator()(const Variable& v);
         void operator()(const Number& n);
         void operator()(const Float& f);
+        void operator()(const FlatExpression& f);
 
         CodeGenerator& gen_;
         int parent_precedence_;
         Operator parent_operator_;
     };
 
+    /**
+     * @struct PendingOutput
+     * @brief Entry of the explicit stack expressions are generated with:
+     * either a subexpression (of a tree or of a `FlatAst`) with its context, a
+     * binary operator or a piece of punctuation still to be printed.
+     */
+    struct PendingOutput {
+        enum class Kind : uint8_t { EXPRESSION, FLAT_NODE, OPERATOR, TEXT };
+
+        Kind kind_;
+        Operator operator_ = Operator::ROOT;  // parent or printed operator
+        int parent_precedence_ = 0;
+        const Expression* expr_ = nullptr;
+        NodeId node_ = 0;
+        const char* text_ = nullptr;
+    };
+
+    std::vector<PendingOutput> pending_;
+
+    void PushExpression(const Expression& expr, int parent_precedence = 0,
+                        Operator parent_operator = Operator::ROOT);
+    void PushFlatNode(NodeId node, int parent_precedence = 0,
+                      Operator parent_operator = Operator::ROOT);
+    void PushOperator(Operator op);
+    void PushText(const char* text);
+
     /**
      * @brief Generates source code for an expression. Accepts parent operator
      * its precedence as context for correctly placing brackets around certain
      * binary operation expressions.
+     *
+     * Subexpressions are not generated recursively: the `Generate*` functions
+     * below print what precedes their operands and push the rest to
+     * `pending_`, which is drained here.
      */
     void GenerateExpression(const Expression& expr, int parent_precedence = 0,
                             Operator parent_operator = Operator::ROOT);
@@ -105,4 +247,31 @@ private:
     void GenerateVariable(const Variable& var);
     void GenerateNumber(const Number& n);
     void GenerateFloat(const Float& f);
+
+    /**
+     * @brief Prints literal values with `std::to_chars`. Floats are printed
+     * with the shortest digits that read back as the same value, in fixed
+     * notation and always with a fractional part, so that they stay floats.
+     */
+    void PrintInteger(int64_t value);
+    void PrintFloat(double value);
+
+    /**
+     * @brief Counterpart of the `Generate*` functions above for a node of
+     * `flat_`, which is generated exactly as the equivalent tree would be.
+     */
+    void GenerateFlatNode(NodeId node, int parent_precedence,
+                          Operator parent_operator);
+
+    /**
+     * @brief Prints the pending output until the stack is `bottom` entries
+     * deep.
+     */
+    void Drain(size_t bottom);
 };
+
+extern template class CodeGenerator<StringSink>;
+extern template class CodeGenerator<FdSink>;
+extern template class CodeGenerator<CountingSink>;
+extern template class CodeGenerator<OStreamSink>;
+extern template class CodeGenerator<CompareSink>;
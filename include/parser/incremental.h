@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "parser.h"
+#include "tokenizer.h"
+
+/**
+ * @class IncrementalParser
+ * @brief Keeps the module of a source file that is being edited, e.g. in an
+ * editor, up to date without parsing the whole file after every edit.
+ *
+ * Every top-level item of the last parse is stored with the state of the
+ * tokenizer where the item began. After an edit, parsing resumes at the last
+ * item the tokenizer got to without looking at the edited bytes, and stops as
+ * soon as it reaches, past the edit, an item of the last parse in the same
+ * state: from there on the tokens, and thus the items, are the ones parsed
+ * before. The new items are spliced into the module in place of the old ones.
+ * The result is the module (or the error) `Parser::ParseFile` gives for the
+ * whole text.
+ *
+ * Nodes are always allocated on the heap, so that replaced declarations are
+ * freed one by one.
+ */
+class IncrementalParser {
+public:
+    /**
+     * @brief Constructs a parser of `text`. Nothing is parsed before the
+     * first `Parse`.
+     */
+    IncrementalParser(std::string text, size_t spaces_per_tab);
+
+    IncrementalParser(const IncrementalParser&) = delete;
+    IncrementalParser& operator=(const IncrementalParser&) = delete;
+
+    /**
+     * @brief Replaces `length` bytes of the text starting at `offset` with
+     * `replacement`. Only the text is changed, edits are parsed by the next
+     * `Parse` all at once.
+     *
+     * @throws Throws `std::out_of_range` if the range is not in the text.
+     */
+    void Edit(size_t offset, size_t length, std::string_view replacement);
+
+    /**
+     * @brief Parses what has changed since the last successful parse.
+     *
+     * @return Returns the module of the whole text, which stays valid until
+     * the next successful `Parse`.
+     *
+     * @throws Throws the errors `Parser::ParseFile` would throw for the whole
+     * text. The module of the last successful parse is left as it is, and the
+     * next `Parse` picks up from the same place.
+     */
+    const Module& Parse();
+
+    std::string_view GetText() const;
+
+private:
+    /**
+     * @struct Item
+     * @brief Top-level item of the last parse: the state of the tokenizer
+     * where parsing of the item began, and the item if it is an import. The
+     * last one has no item, the file module ended there.
+     */
+    struct Item {
+        Tokenizer::Checkpoint start_;
+        size_t declarations_ = 0;  // declarations of the items before it
+        std::optional<Import> import_ = std::nullopt;
+    };
+
+    std::string text_;
+    size_t spaces_per_tab_;
+
+    // The first `valid_` items start where they did in the last parse and the
+    // text the tokenizer read up to them has not changed since. The others
+    // start after every edit since, with offsets updated.
+    std::vector<Item> items_;
+    size_t valid_ = 0;
+    bool parsed_ = false;           // whether the module matches the text
+    bool imports_changed_ = false;  // whether an edit dropped an import
+
+    Module module_;
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Runs `task(0)`, ..., `task(count - 1)` on up to `threads` threads,
+ * the calling one included. Each thread takes the next task not taken yet, so
+ * tasks of uneven cost are spread evenly.
+ *
+ * @throws Rethrows the exception of the first task that threw one, after all
+ * the tasks are done.
+ */
+void ParallelFor(size_t count, size_t threads,
+                 const std::function<void(size_t)>& task);
+
+/**
+ * @brief Variant of `ParallelFor` with a queue per thread. Tasks are dealt to
+ * the queues round-robin in order, so the first tasks start first. A thread
+ * takes tasks from the front of its own queue and, once it is empty, steals
+ * from the back of the others' queues.
+ */
+void ParallelForStealing(size_t count, size_t threads,
+                         const std::function<void(size_t)>& task);
+
+/**
+ * @struct QueueStats
+ * @brief Counters of a `BoundedQueue`: items passed through, the most items
+ * held at once, and how often producers waited for room and consumers for
+ * items.
+ */
+struct QueueStats {
+    size_t pushed_ = 0;
+    size_t peak_size_ = 0;
+    size_t full_waits_ = 0;
+    size_t empty_waits_ = 0;
+};
+
+/**
+ * @class BoundedQueue
+ * @brief FIFO queue between threads holding at most `capacity` items.
+ *
+ * `Push` waits while the queue is full and `Pop` while it is empty. Once the
+ * queue is closed, consumers get the items left and then nothing.
+ */
+template <class T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : capacity_(std::max<size_t>(capacity, 1)) {
+    }
+
+    size_t Capacity() const {
+        return capacity_;
+    }
+
+    void Push(T item) {
+        std::unique_lock lock(mutex_);
+        if (items_.size() == capacity_) {
+            ++stats_.full_waits_;
+            not_full_.wait(lock, [this] { return items_.size() < capacity_; });
+        }
+        items_.push_back(std::move(item));
+        ++stats_.pushed_;
+        stats_.peak_size_ = std::max(stats_.peak_size_, items_.size());
+        not_empty_.notify_one();
+    }
+
+    /**
+     * @brief Takes the oldest item, or returns `std::nullopt` once the queue
+     * is closed and empty.
+     */
+    std::optional<T> Pop() {
+        std::vector<T> items = PopBatch(1);
+        if (items.empty()) {
+            return std::nullopt;
+        }
+        return std::move(items.front());
+    }
+
+    /**
+     * @brief Takes up to `max` oldest items, waiting for at least one. Returns
+     * nothing once the queue is closed and empty.
+     */
+    std::vector<T> PopBatch(size_t max) {
+        std::unique_lock lock(mutex_);
+        if (items_.empty() && !closed_) {
+            ++stats_.empty_waits_;
+            not_empty_.wait(lock,
+                            [this] { return !items_.empty() || closed_; });
+        }
+        size_t count = std::min(max, items_.size());
+        std::vector<T> items(std::make_move_iterator(items_.begin()),
+                             std::make_move_iterator(items_.begin() + count));
+        items_.erase(items_.begin(), items_.begin() + count);
+        not_full_.notify_all();
+        return items;
+    }
+
+    /**
+     * @brief Marks that nothing more will be pushed, waking up the consumers.
+     */
+    void Close() {
+        std::lock_guard lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+    }
+
+    QueueStats GetStats() const {
+        std::lock_guard lock(mutex_);
+        return stats_;
+    }
+
+private:
+    size_t capacity_;
+    mutable std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::deque<T> items_;
+    bool closed_ = false;
+    QueueStats stats_;
+};
@@ -1,41 +1,89 @@
 #pragma once
 
-#include <map>
+#include <cstdint>
 #include <memory>
+#include <memory_resource>
 #include <mutex>
 #include <optional>
-#include <set>
+#include <stdexcept>
+#include <string>
 #include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
+#include "arena.h"
+#include "symbols.h"
 #include "tokenizer.h"
 
 class ParserError : public std::runtime_error {
 public:
     ParserError(std::pair<size_t, size_t> coords, const std::string& msg);
+
+    /**
+     * @brief Gets the line and the column (in bytes) of the error, both
+     * counted from 1.
+     */
+    std::pair<size_t, size_t> GetCoords() const;
+
+    /**
+     * @brief Gets the message without the coordinates `what` starts with.
+     */
+    const std::string& GetDescription() const;
+
+private:
+    std::pair<size_t, size_t> coords_;
+    std::string description_;
 };
 
 // Forward declarations
+class FlatAst;
 struct Module;
 struct UnaryOperation;
 struct BinaryOperation;
 struct FunctionCall;
 struct Function;
 
-using Import =
-    std::pair<std::string, std::pair<std::string, std::set<std::string>>>;
+/**
+ * @struct Import
+ * @brief Stores an import statement: the imported module, its alias (the
+ * module itself if there is none) and the imported functions (none if the
+ * whole module is imported).
+ */
+struct Import {
+    Symbol module_;
+    Symbol alias_;
+    std::pmr::vector<Symbol> functions_;
+};
 
+/**
+ * @class Imports
+ * @brief Merged imports of a module.
+ *
+ * Imports live in a flat vector sorted by module name, and the functions of
+ * every import in a vector sorted by name without repetitions, so they can be
+ * printed by iterating over them as they are.
+ */
 class Imports {
 public:
-    void AddImport(Import import);
+    explicit Imports(
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    /**
+     * @brief Merges `import` into the imports: a module imported again with
+     * the same alias gets the union of the imported functions, or the whole
+     * module if either import is a whole-module one. Names are ordered
+     * through `symbols`.
+     *
+     * @throws Throws `std::runtime_error` if the module has already been
+     * imported with another alias.
+     */
+    void AddImport(Import&& import, const SymbolTable& symbols);
 
-    const std::map<std::string, std::pair<std::string, std::set<std::string>>>&
-    GetImports() const;
+    const std::pmr::vector<Import>& GetImports() const;
 
 private:
-    std::map<std::string, std::pair<std::string, std::set<std::string>>>
-        modules_map_;
+    std::pmr::vector<Import> imports_;
 };
 
 /**
@@ -43,7 +91,7 @@ private:
  * @brief Stores information of a variable token.
  */
 struct Variable {
-    std::string name_;
+    Symbol name_;
 };
 
 /**
@@ -51,7 +99,7 @@ struct Variable {
  * @brief Stores information of an integer token.
  */
 struct Number {
-    int value_;
+    int64_t value_;
 };
 
 /**
@@ -62,18 +110,41 @@ struct Float {
     double value_;
 };
 
+/**
+ * @brief Identifier of a node in a `FlatAst`.
+ */
+using NodeId = uint32_t;
+
+/**
+ * @struct FlatExpression
+ * @brief Stands for a whole expression stored in the `FlatAst` of the file
+ * module, as parsed with `Allocation::FLAT`: the id of its root node.
+ */
+struct FlatExpression {
+    NodeId root_;
+};
+
 /**
  * @brief Alias for all the parts of an expression (sequence of atoms and
  * operators).
  */
 using Expression = std::variant<UnaryOperation, BinaryOperation, FunctionCall,
-                                Variable, Number, Float>;
+                                Variable, Number, Float, FlatExpression>;
+
+/**
+ * @brief Destroys heap expression trees with an explicit stack, so that
+ * deeply nested expressions do not overflow the call stack.
+ */
+template <>
+struct NodeDeleter<Expression> {
+    void operator()(Expression* expr) const;
+};
 
 /**
  * @enum class Operator
  * @brief Stores all possible mathematical operators.
  */
-enum class Operator { ADD, SUB, MUL, DIV, POW, ROOT };
+enum class Operator : uint8_t { ADD, SUB, MUL, DIV, POW, ROOT };
 
 /**
  * @struct UnaryOperation
@@ -82,7 +153,7 @@ enum class Operator { ADD, SUB, MUL, DIV, POW, ROOT };
  */
 struct UnaryOperation {
     Operator op_;
-    std::unique_ptr<Expression> expr_;
+    NodePtr<Expression> expr_;
 };
 
 /**
@@ -92,9 +163,9 @@ struct UnaryOperation {
  * parent binary operation.
  */
 struct BinaryOperation {
-    std::unique_ptr<Expression> lhs_;
+    NodePtr<Expression> lhs_;
     Operator op_;
-    std::unique_ptr<Expression> rhs_;
+    NodePtr<Expression> rhs_;
     Operator parent_operator_ = Operator::ROOT;
 };
 
@@ -103,8 +174,8 @@ struct BinaryOperation {
  * @brief Stores information on function call and its arguments.
  */
 struct FunctionCall {
-    std::string name_;
-    std::vector<Expression> args_;
+    Symbol name_;
+    std::pmr::vector<Expression> args_;
 };
 
 /**
@@ -112,7 +183,7 @@ struct FunctionCall {
  * @brief Stores information of declarations like `let var_name := `.
  */
 struct Constant {  // declarations like `let var_name := ...`
-    std::string name_;
+    Symbol name_;
     Expression value_;
 };
 
@@ -122,8 +193,8 @@ struct Constant {  // declarations like `let var_name := ...`
  * argn) := expression` (possibly with a `where` block).
  */
 struct Function {  // declarations like `let var_name := ... where\n ...`
-    std::string name_;
-    std::vector<std::string> parameters_;
+    Symbol name_;
+    std::pmr::vector<Symbol> parameters_;
     Expression value_;
     std::unique_ptr<Module> body_ = nullptr;
 };
@@ -138,26 +209,71 @@ using Declaration = std::variant<Constant, Function, Module>;
  * @brief Represents a module of a language, which is a name (unless the module
  * is source file), a (possibly empty) list of imports, a (possibly empty) list
  * of declarations.
+ *
+ * Expression nodes and argument lists are allocated from the memory resource
+ * the module was constructed with. When parsing in arena mode the file module
+ * owns the arena, which frees the whole tree at once. In flat mode it also
+ * owns the `FlatAst` all of its expressions are stored in. Names are symbols
+ * of the table owned by the file module.
  */
 struct Module {
-    std::string name_ = "";
+    explicit Module(
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    std::shared_ptr<Arena> arena_ = nullptr;  // declared first, freed last
+    std::shared_ptr<FlatAst> flat_ = nullptr;
+    std::shared_ptr<SymbolTable> symbols_ = nullptr;
+    Symbol name_;
+    Imports imports_;
+    std::pmr::vector<Declaration> declarations_;
+};
+
+/**
+ * @struct FileOutline
+ * @brief What has to be known about a whole file before its top-level
+ * declarations can be generated one by one: all of its imports, which are
+ * printed first wherever they are, and whether any of its submodules is not
+ * empty, which makes all declarations separated by blank lines.
+ */
+struct FileOutline {
+    std::shared_ptr<SymbolTable> symbols_ = nullptr;
     Imports imports_;
-    std::vector<Declaration> declarations_;
+    bool has_nonempty_submodule_ = false;
+};
+
+/**
+ * @enum class Allocation
+ * @brief Selects where `Parser` allocates expression nodes. Only `ParseFile`
+ * stores expressions flat by itself, declarations parsed one by one are
+ * trees unless the parser is given a `FlatAst` with `UseFlatAst`.
+ */
+enum class Allocation {
+    HEAP,   ///< Every node is a separate heap block
+    ARENA,  ///< Nodes live in an `Arena` owned by the parsed file module
+    FLAT    ///< Expressions are `FlatExpression`s, the rest is as with `ARENA`
 };
 
 /**
  * @class Parser
  * @brief Represents a parser of a source file, depends on `Tokenizer` class.
  *
- * The class parses the source file in a recursive manner with the help of
- * `Tokenizer` class.
+ * The class parses declarations in a recursive manner and expressions with
+ * explicit stacks, either pulling tokens one by one from a `Tokenizer` or
+ * walking a `TokenBuffer` produced by `Tokenizer::Tokenize` beforehand.
  */
 class Parser {
 public:
     /**
      * @brief Constructs `Parser` entity using a reference to tokenizer.
      */
-    Parser(Tokenizer& tokenizer);
+    Parser(Tokenizer& tokenizer, Allocation allocation = Allocation::HEAP);
+
+    /**
+     * @brief Constructs `Parser` entity walking an already tokenized source.
+     * The buffer has to outlive the parser.
+     */
+    Parser(const TokenBuffer& tokens,
+           Allocation allocation = Allocation::HEAP);
 
     /**
      * @brief User available function that invokes ParseModule and parses the
@@ -165,6 +281,61 @@ public:
      */
     Module ParseFile();
 
+    /**
+     * @brief Parses the file one top-level declaration at a time instead of
+     * all at once. Imports met before the next declaration are added to
+     * `imports`.
+     *
+     * @return Returns the next declaration, allocated from `arena` (or the
+     * heap if it is null) regardless of the parser's `Allocation`, or nothing
+     * once the file ends.
+     */
+    std::optional<Declaration> ParseNextDeclaration(Imports& imports,
+                                                    Arena* arena = nullptr);
+
+    /**
+     * @brief Finer-grained step of `ParseNextDeclaration`: parses only the
+     * next top-level item, which is either an import added to `imports` or a
+     * declaration stored to `decl`.
+     *
+     * @return Returns false once the file ends.
+     */
+    bool ParseNextItem(Imports& imports, std::optional<Declaration>& decl,
+                       Arena* arena = nullptr);
+
+    /**
+     * @brief Gets the index of the current token of a parser walking a
+     * `TokenBuffer`.
+     */
+    size_t GetTokenIndex() const;
+
+    /**
+     * @brief Makes the `index`-th token the current one of a parser walking a
+     * `TokenBuffer`, e.g. to start parsing at a top-level item found in the
+     * buffer beforehand.
+     */
+    void SeekToken(size_t index);
+
+    /**
+     * @brief Parses the whole file but keeps only its `FileOutline`, freeing
+     * every declaration right after it is parsed.
+     */
+    FileOutline ParseOutline();
+
+    /**
+     * @brief Makes the parser intern names into `symbols`, e.g. the table of
+     * an outline of the same file, so that symbols of separate parses can be
+     * mixed. Has to be called before parsing.
+     */
+    void ShareSymbols(std::shared_ptr<SymbolTable> symbols);
+
+    /**
+     * @brief Makes the parser store the expressions of declarations parsed
+     * one by one into `flat` as `FlatExpression`s, e.g. the `FlatAst` of a
+     * module they are collected into, or trees again if it is null.
+     */
+    void UseFlatAst(FlatAst* flat);
+
 private:
     /**
      * @brief Parses a module entity. As the provided file is technically a
@@ -189,15 +360,22 @@ private:
      */
     Module ParseSubmodule();
 
+    /**
+     * @brief Makes nodes and lists be allocated from `arena`, or from the heap
+     * if it is null.
+     */
+    void UseArena(Arena* arena);
+
     /**
      * @brief Helper function for throwing errors.
      */
     void ThrowError(const std::string& msg);
 
     /**
-     * @brief Helper function for getting current token.
+     * @brief Helper function that moves on to the next token. Checks its type
+     * against `expected` the same way `Tokenizer::ReadToken` does.
      */
-    Token CurrentToken() const;
+    void ReadToken(TokenType expected = TokenType::NONE);
 
     /**
      * @brief Helper function for getting type of the current token.
@@ -207,7 +385,31 @@ private:
     /**
      * @brief Helper function for getting lexeme of the current token.
      */
-    std::string CurrentTokenLexeme() const;
+    std::string_view CurrentTokenLexeme() const;
+
+    /**
+     * @brief Helper functions for getting the value of the current token,
+     * which has to be a literal of the corresponding type.
+     */
+    int64_t CurrentTokenInteger() const;
+    double CurrentTokenFloat() const;
+
+    /**
+     * @brief Helper function for getting line and column right after the
+     * current token.
+     */
+    std::pair<size_t, size_t> CurrentCoords() const;
+
+    /**
+     * @brief Helper function for getting offset right after the current token.
+     * Unlike coordinates, it is cheap to get and can be resolved later.
+     */
+    size_t CurrentPosition() const;
+
+    /**
+     * @brief Helper function for resolving an offset into line and column.
+     */
+    std::pair<size_t, size_t> ResolvePosition(size_t position) const;
 
     /**
      * @brief Helper function that checks whether type of the current token
@@ -221,22 +423,72 @@ private:
      * @brief Parses a name (perhaps "indented", like
      * `module.submodule.entity`).
      */
-    const std::string ParseName();
+    Symbol ParseName();
 
     /**
      * @brief Parses functions getting imported in an import statement.
      */
-    std::set<std::string> ParseImportFunctions();
+    std::pmr::vector<Symbol> ParseImportFunctions();
 
+    /**
+     * @struct PendingOperator
+     * @brief Entry of the operator stack of `ParseExpression`: an operator
+     * waiting for its operands, an open bracket or an open function call.
+     */
+    struct PendingOperator {
+        enum class Kind : uint8_t { BINARY, UNARY, BRACKET, CALL };
+
+        Kind kind_;
+        Operator op_ = Operator::ROOT;
+        Symbol name_ = {};           // name of a call
+        size_t first_argument_ = 0;  // operand stack size when a call opened
+    };
+
+    /**
+     * @brief Parses an expression, into the `FlatAst` of the file if there is
+     * one.
+     */
     Expression ParseExpression();
 
-    // Next several functions parse binary expression of the given priority.
+    /**
+     * @brief Parses an expression by precedence climbing over explicit operand
+     * and operator stacks, so neither the nesting depth nor the length of an
+     * expression is limited by the call stack. Operands are made by `builder`,
+     * either as trees or as nodes of a `FlatAst`.
+     */
+    template <class Builder>
+    typename Builder::Operand ParseExpression(Builder& builder);
 
-    Expression ParseAddSub(Operator parent_operator);
-    Expression ParseMulDiv(Operator parent_operator);
-    Expression ParsePow(Operator parent_operator);
-    Expression ParseUnary(Operator parent_operator);
-    Expression ParseAtom();
+    /**
+     * @brief Parses what can start an operand: an unary minus (unless
+     * `allow_unary` is false, as after `^`), an atom, an opening bracket or
+     * the head of a function call.
+     *
+     * @return Returns true if a complete operand was pushed to `operands`,
+     * false if another operand has to follow.
+     */
+    template <class Builder>
+    bool ParseOperand(bool allow_unary, Builder& builder,
+                      std::vector<typename Builder::Operand>& operands,
+                      std::vector<PendingOperator>& operators);
 
-    Tokenizer& tokenizer_;
+    /**
+     * @brief Pops the binary operator on top of `operators` together with its
+     * operands and pushes the operation back to `operands`.
+     */
+    template <class Builder>
+    void ReduceBinary(Builder& builder,
+                      std::vector<typename Builder::Operand>& operands,
+                      std::vector<PendingOperator>& operators);
+
+    // Exactly one of the two token sources is set.
+    Tokenizer* tokenizer_ = nullptr;
+    const TokenBuffer* tokens_ = nullptr;
+    size_t index_ = 0;
+
+    Allocation allocation_;
+    Arena* arena_ = nullptr;    // set while parsing a file in arena mode
+    FlatAst* flat_ = nullptr;   // set while parsing in flat mode
+    std::pmr::memory_resource* resource_ = std::pmr::get_default_resource();
+    std::shared_ptr<SymbolTable> symbols_ = std::make_shared<SymbolTable>();
 };
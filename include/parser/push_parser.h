@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+#include "arena.h"
+#include "parser.h"
+#include "tokenizer.h"
+
+/**
+ * @class PushParser
+ * @brief Parses a source file that is handed over in chunks as it arrives,
+ * e.g. from a pipe or a socket, instead of pulling tokens from a complete
+ * source.
+ *
+ * Every `Feed` parses as many top-level items as the input fed so far allows.
+ * When the tokenizer runs out of complete lines in the middle of an item, the
+ * parser suspends by going back to where the item started and parses it again
+ * once more input has arrived. Retries wait until the unparsed input has
+ * doubled, so on average every byte is parsed a constant number of times.
+ * The result is the module (or the error) `Parser::ParseFile` gives for the
+ * whole source.
+ */
+class PushParser {
+public:
+    /**
+     * @brief Constructs a parser allocating the module as `allocation`
+     * selects, as `Parser::ParseFile` would.
+     */
+    explicit PushParser(size_t spaces_per_tab,
+                        Allocation allocation = Allocation::HEAP);
+
+    PushParser(const PushParser&) = delete;
+    PushParser& operator=(const PushParser&) = delete;
+
+    /**
+     * @brief Appends `chunk` to the source and parses what can be parsed.
+     *
+     * @throws Throws the errors `Parser::ParseFile` would throw, as soon as
+     * the input they are about has been fed. The parser cannot be used after
+     * that.
+     */
+    void Feed(std::string_view chunk);
+
+    /**
+     * @brief Marks the source as complete and parses the rest of it. Has to be
+     * called once, after all `Feed`s.
+     *
+     * @return Returns the parsed file module.
+     */
+    Module Finish();
+
+private:
+    /**
+     * @brief Parses top-level items until the file or the readable input ends.
+     */
+    void Advance();
+
+    Tokenizer tokenizer_;
+    Allocation allocation_;
+    std::optional<Parser> parser_;      // created once there is a first token
+    Tokenizer::Checkpoint checkpoint_;  // where the next item starts
+    size_t retry_size_ = 0;  // readable bytes past `checkpoint_` to retry at
+    bool done_ = false;
+
+    std::shared_ptr<Arena> arena_;  // declared first, freed last
+    Module module_;
+};
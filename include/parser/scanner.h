@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+/**
+ * @brief Bit flags describing which character classes a byte belongs to.
+ *
+ * The classes mirror what the tokenizer used to ask `<cctype>` for in the "C"
+ * locale: `kCharBlank` is `std::isspace` without '\n' (which is a token on its
+ * own), `kCharAlpha` is `std::isalpha` and `kCharDigit` is `std::isdigit`.
+ */
+inline constexpr uint8_t kCharDigit = 1 << 0;
+inline constexpr uint8_t kCharAlpha = 1 << 1;
+inline constexpr uint8_t kCharUnderscore = 1 << 2;
+inline constexpr uint8_t kCharBlank = 1 << 3;
+
+inline constexpr uint8_t kCharWord = kCharDigit | kCharAlpha | kCharUnderscore;
+
+/**
+ * @brief 256-entry character class table indexed by `unsigned char`.
+ */
+inline constexpr std::array<uint8_t, 256> kCharClass = [] {
+    std::array<uint8_t, 256> table{};
+    for (int c = '0'; c <= '9'; ++c) {
+        table[c] |= kCharDigit;
+    }
+    for (int c = 'a'; c <= 'z'; ++c) {
+        table[c] |= kCharAlpha;
+        table[c - 'a' + 'A'] |= kCharAlpha;
+    }
+    table['_'] |= kCharUnderscore;
+    for (unsigned char c : {' ', '\t', '\v', '\f', '\r'}) {
+        table[c] |= kCharBlank;
+    }
+    return table;
+}();
+
+/**
+ * @brief Gets the class flags of a character as returned by
+ * `Tokenizer::Peek`, i.e. -1 for the end of the source.
+ */
+constexpr uint8_t CharClassOf(int c) {
+    return c < 0 ? 0 : kCharClass[static_cast<unsigned char>(c)];
+}
+
+/**
+ * @brief Returns the first position in `[begin, end)` that is not a letter,
+ * a digit or an underscore.
+ */
+const char *ScanWord(const char *begin, const char *end);
+
+/**
+ * @brief Returns the first position in `[begin, end)` that is not a digit.
+ */
+const char *ScanDigits(const char *begin, const char *end);
+
+/**
+ * @brief Returns the first position in `[begin, end)` that is not a blank
+ * (whitespace other than '\n').
+ */
+const char *ScanBlanks(const char *begin, const char *end);
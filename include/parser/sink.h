@@ -0,0 +1,265 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+/**
+ * @concept OutputSink
+ * @brief Destination `CodeGenerator` writes generated source code to.
+ *
+ * A sink accepts runs of bytes (`Write`), single bytes (`Put`) and runs of a
+ * repeated byte (`Fill`, used for indentation). Sinks are used by reference
+ * and are not expected to be copied.
+ */
+template <class S>
+concept OutputSink =
+    requires(S& sink, std::string_view text, char c, size_t count) {
+        sink.Write(text);
+        sink.Put(c);
+        sink.Fill(c, count);
+    };
+
+/**
+ * @class StringSink
+ * @brief Collects the output in a growable contiguous buffer.
+ */
+class StringSink {
+public:
+    void Write(std::string_view text) {
+        buffer_.append(text);
+    }
+
+    void Put(char c) {
+        buffer_.push_back(c);
+    }
+
+    void Fill(char c, size_t count) {
+        buffer_.append(count, c);
+    }
+
+    std::string_view View() const {
+        return buffer_;
+    }
+
+    /**
+     * @brief Moves the collected output out, leaving the sink empty.
+     */
+    std::string Release() {
+        return std::move(buffer_);
+    }
+
+private:
+    std::string buffer_;
+};
+
+/**
+ * @class FdSink
+ * @brief Writes the output to a file descriptor in large blocks.
+ *
+ * Output is gathered in a fixed-size buffer and handed to the descriptor once
+ * the buffer is full; writes larger than the buffer go to the descriptor
+ * directly.
+ */
+class FdSink {
+public:
+    static constexpr size_t kBufferSize = 1 << 20;
+    static constexpr int kStandardOutput = 1;
+
+    /**
+     * @brief Constructs a sink writing to `fd`, which stays owned by the
+     * caller.
+     */
+    explicit FdSink(int fd);
+
+    /**
+     * @brief Constructs a sink writing to the file at `path`, which is created
+     * or truncated, and closed together with the sink.
+     *
+     * @throws Throws `std::system_error` if the file cannot be opened.
+     */
+    explicit FdSink(const std::string& path);
+
+    FdSink(const FdSink&) = delete;
+    FdSink& operator=(const FdSink&) = delete;
+
+    /**
+     * @brief Flushes what is left, ignoring errors. Call `Flush` beforehand to
+     * have them reported.
+     */
+    ~FdSink();
+
+    void Write(std::string_view text) {
+        if (text.size() > kBufferSize - used_) {
+            WriteSlow(text);
+            return;
+        }
+        text.copy(buffer_.get() + used_, text.size());
+        used_ += text.size();
+    }
+
+    void Put(char c) {
+        if (used_ == kBufferSize) {
+            Flush();
+        }
+        buffer_[used_++] = c;
+    }
+
+    void Fill(char c, size_t count);
+
+    /**
+     * @brief Hands the buffered output to the descriptor.
+     *
+     * @throws Throws `std::system_error` if writing fails.
+     */
+    void Flush();
+
+private:
+    void WriteSlow(std::string_view text);
+
+    /**
+     * @brief Writes `text` to the descriptor in full, retrying after partial
+     * writes and interrupts.
+     */
+    void WriteAll(std::string_view text);
+
+    int fd_;
+    bool owns_fd_ = false;
+    std::unique_ptr<char[]> buffer_;
+    size_t used_ = 0;
+};
+
+/**
+ * @brief Atomically replaces the file at `path`, following symbolic links,
+ * with what `generate` writes to the sink it is given. The output goes to a
+ * temporary file next to the original first, which then gets the original's
+ * permissions and is renamed over it, so readers see either the old file or
+ * the whole new one.
+ *
+ * @throws Throws `std::system_error` if the file cannot be replaced, and
+ * rethrows what `generate` throws; the original is left as is in either case.
+ */
+void ReplaceFile(const std::string& path,
+                 const std::function<void(FdSink&)>& generate);
+
+/**
+ * @class CountingSink
+ * @brief Discards the output and only counts its size in bytes.
+ */
+class CountingSink {
+public:
+    void Write(std::string_view text) {
+        size_ += text.size();
+    }
+
+    void Put(char) {
+        ++size_;
+    }
+
+    void Fill(char, size_t count) {
+        size_ += count;
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+private:
+    size_t size_ = 0;
+};
+
+/**
+ * @class OStreamSink
+ * @brief Writes the output to a `std::ostream`.
+ */
+class OStreamSink {
+public:
+    explicit OStreamSink(std::ostream& out) : out_(out) {
+    }
+
+    void Write(std::string_view text) {
+        out_.write(text.data(), static_cast<std::streamsize>(text.size()));
+    }
+
+    void Put(char c) {
+        out_.put(c);
+    }
+
+    void Fill(char c, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            out_.put(c);
+        }
+    }
+
+private:
+    std::ostream& out_;
+};
+
+/**
+ * @class OutputMismatch
+ * @brief Thrown by a `CompareSink` at the first byte of the output that
+ * differs from the expected text.
+ */
+class OutputMismatch : public std::exception {
+public:
+    explicit OutputMismatch(size_t offset);
+
+    const char* what() const noexcept override;
+
+    /**
+     * @brief Gets the offset of the first difference in the expected text.
+     */
+    size_t GetOffset() const;
+
+private:
+    size_t offset_;
+};
+
+/**
+ * @class CompareSink
+ * @brief Compares the output against an expected text as it is written,
+ * keeping none of it, and throws `OutputMismatch` at the first difference.
+ */
+class CompareSink {
+public:
+    /**
+     * @brief Constructs a sink comparing against `expected`, which has to
+     * outlive the sink.
+     */
+    explicit CompareSink(std::string_view expected) : expected_(expected) {
+    }
+
+    void Write(std::string_view text) {
+        if (expected_.compare(pos_, text.size(), text) != 0) {
+            ThrowMismatch(text);
+        }
+        pos_ += text.size();
+    }
+
+    void Put(char c) {
+        if (pos_ == expected_.size() || expected_[pos_] != c) {
+            throw OutputMismatch(pos_);
+        }
+        ++pos_;
+    }
+
+    void Fill(char c, size_t count);
+
+    /**
+     * @brief Checks that the output did not stop short of the expected text.
+     *
+     * @throws Throws `OutputMismatch` if it did.
+     */
+    void Finish() const;
+
+private:
+    [[noreturn]] void ThrowMismatch(std::string_view text) const;
+
+    std::string_view expected_;
+    size_t pos_ = 0;
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+/**
+ * @class Source
+ * @brief Represents the contents of a source file as one contiguous buffer.
+ *
+ * The tokenizer reads characters directly from this buffer instead of going
+ * through `std::istream`. The bytes either belong to a memory-mapped file, are
+ * owned by the object itself (e.g. after reading a stream), or are borrowed
+ * from the caller. Copies are cheap and share the underlying storage.
+ */
+class Source {
+public:
+    /**
+     * @brief Constructs an empty source.
+     */
+    Source();
+
+    /**
+     * @brief Constructs a source borrowing `text`. The caller has to keep the
+     * referenced memory alive for as long as the source (and anything
+     * tokenized from it) is in use.
+     */
+    static Source FromView(std::string_view text);
+
+    /**
+     * @brief Constructs a source owning `text`.
+     */
+    static Source FromString(std::string text);
+
+    /**
+     * @brief Constructs a source by reading `in` until its end.
+     */
+    static Source FromStream(std::istream& in);
+
+    /**
+     * @brief Constructs a source from the file at `path`. Regular files are
+     * memory-mapped, anything else (pipes, character devices) is read into
+     * memory.
+     *
+     * @throws Throws `std::system_error` if the file cannot be opened or read.
+     */
+    static Source FromFile(const std::string& path);
+
+    /**
+     * @brief Constructs a source by reading the file at `path` into memory
+     * right away, asking the system to read ahead where it can. Unlike with
+     * `FromFile`, using the source never waits for the disk.
+     *
+     * @throws Throws `std::system_error` if the file cannot be opened or read.
+     */
+    static Source ReadFile(const std::string& path);
+
+    /**
+     * @brief Gets the whole contents of the source.
+     */
+    std::string_view View() const;
+
+    const char* Data() const;
+    size_t Size() const;
+
+    /**
+     * @brief Resolves a byte offset into a 1-based line and column, the column
+     * being the one of the character at `offset`. Offsets past the end of the
+     * source continue its last line.
+     *
+     * The index of line starts is only built on the first call, so sources
+     * that are never asked for coordinates do not pay for it. Safe to call
+     * from several threads.
+     */
+    std::pair<size_t, size_t> GetCoords(size_t offset) const;
+
+private:
+    struct LineIndex;
+
+    Source(std::shared_ptr<const void> storage, std::string_view view);
+
+    std::shared_ptr<const void> storage_;
+    std::string_view view_;
+    std::shared_ptr<LineIndex> lines_;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <compare>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "arena.h"
+
+/**
+ * @struct Symbol
+ * @brief Compact id of a name interned in a `SymbolTable`. The default symbol
+ * stands for the empty name.
+ */
+struct Symbol {
+    uint32_t id_ = 0;
+
+    auto operator<=>(const Symbol& other) const = default;
+};
+
+/**
+ * @class SymbolTable
+ * @brief Stores every distinct name (identifier or dotted qualified name) once
+ * and hands out `Symbol`s for them.
+ *
+ * Equal names always get equal symbols, so comparing names becomes comparing
+ * integers. Names are resolved back to text only when printing. The
+ * characters live in an arena and the lookup is an open-addressing table of
+ * ids, so interning a name seen before does not allocate.
+ */
+class SymbolTable {
+public:
+    SymbolTable();
+    SymbolTable(const SymbolTable&) = delete;
+    SymbolTable& operator=(const SymbolTable&) = delete;
+
+    /**
+     * @brief Gets the symbol of `name`, adding the name to the table if it is
+     * seen for the first time.
+     */
+    Symbol Intern(std::string_view name);
+
+    /**
+     * @brief Gets the name a symbol stands for. The view stays valid for the
+     * lifetime of the table.
+     */
+    std::string_view GetName(Symbol symbol) const;
+
+    /**
+     * @brief Gets number of distinct names in the table.
+     */
+    size_t Size() const;
+
+private:
+    static uint64_t Hash(std::string_view name);
+
+    void Grow();
+
+    Arena chars_;
+    std::vector<std::string_view> names_;
+    std::vector<uint64_t> hashes_;  // parallel to `names_`
+    std::vector<uint32_t> slots_;   // symbol id + 1, 0 for an empty slot
+};
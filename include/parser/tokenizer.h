@@ -1,22 +1,49 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <stack>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
 #include <variant>
+#include <vector>
+
+#include "source.h"
 
 class TokenizerError : public std::runtime_error {
 public:
     explicit TokenizerError(std::pair<size_t, size_t> coords,
                             const std::string &msg);
 
+    /**
+     * @brief Gets the line and the column (in bytes) of the error, both
+     * counted from 1.
+     */
+    std::pair<size_t, size_t> GetCoords() const;
+
+    /**
+     * @brief Gets the message without the coordinates `what` starts with.
+     */
+    const std::string &GetDescription() const;
+
 private:
-    char *msg_;
+    std::pair<size_t, size_t> coords_;
+    std::string description_;
+};
+
+/**
+ * @class NeedMoreInput
+ * @brief Thrown by a `Tokenizer` in push mode that ran out of the source fed
+ * so far before it can tell what the next token is.
+ */
+class NeedMoreInput : public std::exception {
+public:
+    const char *what() const noexcept override;
 };
 
 /**
@@ -27,7 +54,7 @@ private:
  * programming language, plus several "meta-tokens" such as EOL, denting symbols
  * etc.
  */
-enum class TokenType {
+enum class TokenType : uint8_t {
     // Keywords
     IMPORT,
     AS,
@@ -106,18 +133,193 @@ private:
     std::optional<std::string> lexeme_;
 };
 
+/**
+ * @brief Checks whether tokens of the given type carry a lexeme (keywords,
+ * identifiers and number literals do).
+ */
+bool HasLexeme(TokenType type);
+
+/**
+ * @brief Builds the message reported when a token of type `got` is read where
+ * a token of type `expected` is required.
+ */
+std::string UnexpectedTokenMessage(TokenType expected, TokenType got);
+
+/**
+ * @struct LexedToken
+ * @brief Compact plain-old-data token stored in a `TokenBuffer`.
+ *
+ * Instead of owning its lexeme the token refers to the bytes
+ * `[offset_, offset_ + length_)` of the source. Tokens that do not consume
+ * any characters (indents, dedents, repeated ends of line) have zero length,
+ * so `offset_ + length_` is always the position right after the token.
+ */
+struct LexedToken {
+    TokenType type_;
+    uint32_t offset_;
+    uint32_t length_;
+
+    bool operator==(const LexedToken &other) const = default;
+};
+
+static_assert(sizeof(LexedToken) <= 12);
+
+/**
+ * @class TokenBuffer
+ * @brief Result of tokenizing a whole source up front: a flat array of
+ * `LexedToken`s ending with `TokenType::FILE_END`.
+ *
+ * If tokenization failed, the array ends right before the offending token and
+ * the error is kept so that it can be reported at the same point of parsing
+ * where reading tokens one by one would have reported it.
+ */
+class TokenBuffer {
+public:
+    /**
+     * @brief Largest source (in bytes) that fits into 32-bit token offsets.
+     */
+    static constexpr size_t kMaxSourceSize = UINT32_MAX;
+
+    size_t Size() const;
+    const LexedToken &operator[](size_t index) const;
+
+    /**
+     * @brief Gets lexeme of the `index`-th token as a view into the source.
+     */
+    std::string_view GetLexeme(size_t index) const;
+
+    /**
+     * @brief Gets the value of the `index`-th token, which has to be a
+     * `TokenType::INTEGER` or a `TokenType::FLOAT` literal respectively.
+     * Literals are decoded once while tokenizing.
+     */
+    int64_t GetInteger(size_t index) const;
+    double GetFloat(size_t index) const;
+
+    /**
+     * @brief Gets offset right after the `index`-th token.
+     */
+    size_t GetPosition(size_t index) const;
+
+    /**
+     * @brief Gets line and column right after the `index`-th token, in the
+     * same form as `Tokenizer::GetCoords`. Resolved lazily through the source.
+     */
+    std::pair<size_t, size_t> GetCoords(size_t index) const;
+
+    /**
+     * @brief Gets the error that stopped tokenization, if any.
+     */
+    const std::optional<TokenizerError> &GetError() const;
+
+    const Source &GetSource() const;
+
+    /**
+     * @brief Checks whether both buffers hold the same tokens, literal values
+     * and error. Sources are not compared.
+     */
+    bool operator==(const TokenBuffer &other) const;
+    bool operator!=(const TokenBuffer &other) const;
+
+private:
+    friend class Tokenizer;
+
+    /**
+     * @brief Gets the position of the value of the `index`-th token in
+     * `literal_values_`.
+     */
+    size_t FindLiteral(size_t index) const;
+
+    Source source_;
+    std::vector<LexedToken> tokens_;
+    std::optional<TokenizerError> error_;
+
+    // Indices of the literal tokens, ascending, and the bits of their values.
+    std::vector<uint32_t> literal_tokens_;
+    std::vector<uint64_t> literal_values_;
+};
+
 /**
  * @class Tokenizer
  * @brief Represents tokenizer of the source file.
  */
 class Tokenizer {
 public:
+    /**
+     * @brief Smallest part of a source worth lexing on a separate thread.
+     */
+    static constexpr size_t kMinChunkSize = 1 << 20;
+
+    /**
+     * @brief Construct tokenizer entity from a source buffer (from where to
+     * read) and a meta parameter `spaces_per_tab`.
+     */
+    Tokenizer(Source source, size_t spaces_per_tab);
+
+    /**
+     * @brief Construct tokenizer entity over an in-memory text. The text is
+     * borrowed and has to outlive the tokenizer.
+     */
+    Tokenizer(std::string_view text, size_t spaces_per_tab);
+
     /**
      * @brief Construct tokenizer entity from `std::istream` object (from where
-     * to read) and a meta parameter `spaces_per_tab`.
+     * to read) and a meta parameter `spaces_per_tab`. The stream is read into
+     * memory in full before tokenizing.
      */
     Tokenizer(std::istream *ptr, size_t spaces_per_tab);
 
+    /**
+     * @brief Construct tokenizer entity in push mode: the source is handed
+     * over in chunks with `Feed` as it arrives, and `Finish` tells that it is
+     * complete. Until then lines are only tokenized once their end of line
+     * has been fed, and `ReadToken` throws `NeedMoreInput` when it reaches
+     * the end of the complete lines.
+     */
+    explicit Tokenizer(size_t spaces_per_tab);
+
+    /**
+     * @brief Appends `chunk` to the source of a tokenizer in push mode.
+     */
+    void Feed(std::string_view chunk);
+
+    /**
+     * @brief Marks the source of a tokenizer in push mode as complete.
+     */
+    void Finish();
+
+    /**
+     * @brief Gets how many bytes of the source can be tokenized so far:
+     * everything up to the last end of line fed, or all of it once finished.
+     */
+    size_t GetReadableSize() const;
+
+    /**
+     * @struct Checkpoint
+     * @brief Current token and indentation context of a tokenizer to resume
+     * from. Positions are kept as offsets, so that a checkpoint stays valid
+     * when more input is fed.
+     */
+    struct Checkpoint {
+        size_t pos_;
+        size_t token_begin_;
+        TokenType current_type_;
+        int64_t integer_value_;
+        double float_value_;
+        size_t dedents_;
+        bool substruct_started_;
+        std::stack<size_t, std::vector<size_t>> indents_;
+        size_t current_indent_spaces_;
+        size_t indentation_level_;
+    };
+
+    /**
+     * @brief Saves the state of the tokenizer, e.g. to go back to it after
+     * `NeedMoreInput` was thrown.
+     */
+    Checkpoint Save() const;
+    void Restore(const Checkpoint &checkpoint);
+
     /**
      * @brief Reads a new token from the stream.
      *
@@ -132,26 +334,139 @@ public:
      */
     Token GetToken() const;
 
+    /**
+     * @brief Gets type of the last read token.
+     */
+    TokenType GetTokenType() const;
+
+    /**
+     * @brief Gets lexeme of the last read token as a view into the source.
+     */
+    std::string_view GetTokenLexeme() const;
+
+    /**
+     * @brief Gets offset of the first byte of the last read token.
+     */
+    size_t GetTokenOffset() const;
+
+    /**
+     * @brief Gets the value of the last read token, which has to be a
+     * `TokenType::INTEGER` or a `TokenType::FLOAT` literal respectively.
+     */
+    int64_t GetTokenInteger() const;
+    double GetTokenFloat() const;
+
+    /**
+     * @brief Reads all the remaining tokens into a flat array.
+     *
+     * Given more than one thread, a tokenizer that has not read anything yet
+     * splits a source at ends of lines into chunks of at least
+     * `min_chunk_size` bytes and lexes them concurrently, every line on its
+     * own. A sequential pass then applies the
+     * indentation of the lines in order to put indents and dedents between
+     * them and to find the first error, so the result is identical to the one
+     * of a single thread.
+     *
+     * @throws Throws `std::length_error` if the source does not fit into
+     * `TokenBuffer::kMaxSourceSize`. Tokenizer errors are not thrown but
+     * stored in the buffer.
+     */
+    TokenBuffer Tokenize(size_t threads = 1,
+                         size_t min_chunk_size = kMinChunkSize);
+
     /**
      * @brief Function that returns current line and column.
      */
     std::pair<size_t, size_t> GetCoords() const;
 
+    /**
+     * @brief Gets offset of the current position, i.e. right after the last
+     * read token.
+     */
+    size_t GetPosition() const;
+
+    const Source &GetSource() const;
+
 private:
     /**
-     * @brief Helper function for throwing errors.
+     * @brief Helper function for throwing errors at the current position or
+     * at the given offset.
      */
     void ThrowError(std::string msg);
+    void ThrowError(std::string msg, size_t offset);
+
+    /**
+     * @brief Handles the start of a line: skips a blank one and applies the
+     * indentation of any other.
+     *
+     * @return Returns true if the current token (`TokenType::EOL`,
+     * `TokenType::INDENT` or `TokenType::DEDENT`) is set.
+     */
+    bool ReadLineStart();
+
+    /**
+     * @brief Helper function for getting the width of the indentation
+     * `[begin, end)`, with tabs expanded.
+     */
+    size_t IndentWidth(const char *begin, const char *end) const;
 
     /**
-     * @brief Helper function for reading a character from stream, keeping track
-     * of line and column.
+     * @brief Updates the indentation context with a line indented by
+     * `new_indent` spaces.
+     *
+     * @return Returns true if `TokenType::INDENT` or `TokenType::DEDENT` was
+     * made the current token. Further dedents are left in `dedents_`.
+     */
+    bool ApplyIndent(size_t new_indent);
+
+    /**
+     * @brief Reads the token at the current position, which is not the start
+     * of a line.
+     */
+    void ReadLineToken();
+
+    struct LexedLine;
+    struct LexedChunk;
+
+    /**
+     * @brief Parallel part of `Tokenize`: lexes the lines of `chunk` without
+     * an indentation context.
+     */
+    void LexLines(LexedChunk &chunk);
+
+    /**
+     * @brief Tokenizes the source split into `threads` chunks.
+     */
+    TokenBuffer TokenizeParallel(size_t threads);
+
+    /**
+     * @brief Helper function that adds the current token to `buffer`.
+     */
+    void AppendToken(TokenBuffer &buffer) const;
+
+    /**
+     * @brief Helper function that makes `type` the current token, starting at
+     * `begin` and ending at the current position.
+     */
+    void SetToken(TokenType type, const char *begin);
+
+    /**
+     * @brief Helper function for looking at the next character without
+     * consuming it. Returns -1 at the end of the source.
+     */
+    int Peek() const;
+
+    /**
+     * @brief Helper function for reading a character from source.
      */
     char StreamRead();
 
     /**
      * @brief Helper function for reading a token of types `TokenType::NUMBER`
-     * and `TokenType::FLOAT`.
+     * and `TokenType::FLOAT`. Decodes its value as well.
+     *
+     * @throws Throws an error if the value does not fit into `int64_t` or
+     * `double` respectively.
      */
     void ReadNumber();
 
@@ -160,19 +475,27 @@ private:
      */
     void ReadWord();
 
-    std::istream *in_;
-    Token current_token_;
+    Source source_;
+    const char *pos_;
+    const char *end_;
+    TokenType current_type_ = TokenType::EOL;
+    const char *token_begin_;
+    int64_t integer_value_ = 0;
+    double float_value_ = 0.0;
 
     size_t spaces_per_tab_;
 
     size_t dedents_ = 0;
 
-    // Context for processing indentation
+    // Context for processing indentation. The stack is a vector, so that
+    // checkpoints saved outside of any block do not allocate.
     bool substruct_started_ = false;
-    std::stack<size_t> indents_;
+    std::stack<size_t, std::vector<size_t>> indents_;
     size_t current_indent_spaces_ = 0;
     size_t indentation_level_ = 0;
 
-    size_t line_ = 1;
-    size_t column_ = 1;
+    // Push mode only: the source fed so far, which `source_` borrows, and
+    // whether it is complete.
+    std::unique_ptr<std::string> fed_ = nullptr;
+    bool finished_ = true;
 };
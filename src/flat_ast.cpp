@@ -0,0 +1,89 @@
+#include <parser/flat_ast.h>
+
+#include <cstring>
+
+NodeId FlatAst::AddUnaryOperation(Operator op, NodeId operand) {
+    return AddNode(NodeKind::UNARY_OPERATION, op, operand);
+}
+
+NodeId FlatAst::AddBinaryOperation(NodeId lhs, Operator op, NodeId rhs) {
+    return AddNode(NodeKind::BINARY_OPERATION, op,
+                   lhs | uint64_t{rhs} << 32);
+}
+
+NodeId FlatAst::AddFunctionCall(Symbol name,
+                                std::span<const NodeId> arguments) {
+    uint64_t first = arguments_.size();
+    arguments_.push_back(name.id_);
+    arguments_.insert(arguments_.end(), arguments.begin(), arguments.end());
+    return AddNode(NodeKind::FUNCTION_CALL, Operator::ROOT,
+                   first | uint64_t{arguments.size()} << 32);
+}
+
+NodeId FlatAst::AddVariable(Symbol name) {
+    return AddNode(NodeKind::VARIABLE, Operator::ROOT, name.id_);
+}
+
+NodeId FlatAst::AddNumber(int64_t value) {
+    return AddNode(NodeKind::NUMBER, Operator::ROOT,
+                   static_cast<uint64_t>(value));
+}
+
+NodeId FlatAst::AddFloat(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return AddNode(NodeKind::FLOAT, Operator::ROOT, bits);
+}
+
+size_t FlatAst::Size() const {
+    return kinds_.size();
+}
+
+NodeKind FlatAst::GetKind(NodeId node) const {
+    return kinds_[node];
+}
+
+Operator FlatAst::GetOperator(NodeId node) const {
+    return operators_[node];
+}
+
+NodeId FlatAst::GetLhs(NodeId node) const {
+    return static_cast<NodeId>(data_[node]);
+}
+
+NodeId FlatAst::GetRhs(NodeId node) const {
+    return static_cast<NodeId>(data_[node] >> 32);
+}
+
+Symbol FlatAst::GetName(NodeId node) const {
+    if (kinds_[node] == NodeKind::FUNCTION_CALL) {
+        return Symbol{arguments_[static_cast<uint32_t>(data_[node])]};
+    }
+    return Symbol{static_cast<uint32_t>(data_[node])};
+}
+
+size_t FlatAst::GetArgumentCount(NodeId node) const {
+    return data_[node] >> 32;
+}
+
+NodeId FlatAst::GetArgument(NodeId node, size_t index) const {
+    // The first slot of a call's block holds its name.
+    return arguments_[static_cast<uint32_t>(data_[node]) + 1 + index];
+}
+
+int64_t FlatAst::GetNumber(NodeId node) const {
+    return static_cast<int64_t>(data_[node]);
+}
+
+double FlatAst::GetFloat(NodeId node) const {
+    double value;
+    std::memcpy(&value, &data_[node], sizeof(value));
+    return value;
+}
+
+NodeId FlatAst::AddNode(NodeKind kind, Operator op, uint64_t data) {
+    kinds_.push_back(kind);
+    operators_.push_back(op);
+    data_.push_back(data);
+    return static_cast<NodeId>(kinds_.size() - 1);
+}
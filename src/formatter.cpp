@@ -1,38 +1,119 @@
 #include <parser/constants.h>
 #include <parser/formatter.h>
+#include <parser/parallel.h>
 #include <parser/parser.h>
+#include <parser/scanner.h>
 
-CodeGenerator::CodeGenerator(std::ostream& out) : out_(out) {
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+template <OutputSink Sink>
+CodeGenerator<Sink>::CodeGenerator(Sink& out) : out_(out) {
 }
 
-void CodeGenerator::Generate(const Module& module) {
+template <OutputSink Sink>
+void CodeGenerator<Sink>::Generate(const Module& module) {
+    symbols_ = module.symbols_.get();
+    flat_ = module.flat_.get();
     GenerateModule(module);
-    out_ << "\n";
+    out_.Put('\n');
+}
+
+template <OutputSink Sink>
+void CodeGenerator<Sink>::GenerateStreaming(const Source& source,
+                                            size_t spaces_per_tab,
+                                            const FileOutline& outline) {
+    Tokenizer tokenizer(source, spaces_per_tab);
+    Parser parser(tokenizer);
+    parser.ShareSymbols(outline.symbols_);
+    symbols_ = outline.symbols_.get();
+    GenerateImports(outline.imports_);
+    Imports skipped_imports;  // already printed from the outline
+    Arena arena;
+    bool first_decl = true;
+    while (true) {
+        std::optional<Declaration> decl =
+            parser.ParseNextDeclaration(skipped_imports, &arena);
+        if (!decl) {
+            break;
+        }
+        if (!first_decl) {
+            if (outline.has_nonempty_submodule_) {
+                out_.Put('\n');
+            }
+            NewLine();
+        }
+        GenerateDeclaration(*decl);
+        first_decl = false;
+        decl.reset();
+        arena.release();
+    }
+    out_.Put('\n');
 }
 
-void CodeGenerator::Indent() {
-    for (size_t i = 0; i < indent_level_; ++i) {
-        out_ << "  ";
+template <OutputSink Sink>
+void CodeGenerator<Sink>::Generate(const PreformattedFile& file) {
+    symbols_ = file.symbols_.get();
+    GenerateImports(file.imports_);
+    bool first_decl = true;
+    for (size_t i = 0; i < file.texts_.size(); ++i) {
+        std::string_view text = file.texts_[i];
+        size_t begin = 0;
+        for (size_t end : file.declaration_ends_[i]) {
+            if (!first_decl) {
+                if (file.has_nonempty_submodule_) {
+                    out_.Put('\n');
+                }
+                NewLine();
+            }
+            out_.Write(text.substr(begin, end - begin));
+            begin = end;
+            first_decl = false;
+        }
     }
+    out_.Put('\n');
 }
 
-void CodeGenerator::NewLine() {
-    out_ << '\n';
+template <OutputSink Sink>
+std::string_view CodeGenerator<Sink>::Name(Symbol symbol) const {
+    return symbols_->GetName(symbol);
+}
+
+template <OutputSink Sink>
+void CodeGenerator<Sink>::Indent() {
+    out_.Fill(' ', 2 * indent_level_);
+}
+
+template <OutputSink Sink>
+void CodeGenerator<Sink>::NewLine() {
+    out_.Put('\n');
     Indent();
 }
 
-void CodeGenerator::StartBlock() {
+template <OutputSink Sink>
+void CodeGenerator<Sink>::StartBlock() {
     ++indent_level_;
     NewLine();
 }
 
-void CodeGenerator::EndBlock() {
+template <OutputSink Sink>
+void CodeGenerator<Sink>::EndBlock() {
     --indent_level_;
 }
 
-void CodeGenerator::GenerateModule(const Module& module) {
-    if (!module.name_.empty()) {
-        out_ << "module " << module.name_ << " where";
+template <OutputSink Sink>
+void CodeGenerator<Sink>::GenerateModule(const Module& module) {
+    if (module.name_ != Symbol{}) {
+        out_.Write("module ");
+        out_.Write(Name(module.name_));
+        out_.Write(" where");
         StartBlock();
     }
     GenerateImports(module.imports_);
@@ -51,140 +132,229 @@ void CodeGenerator::GenerateModule(const Module& module) {
     for (const auto& decl : module.declarations_) {
         if (!first_decl) {
             if (newline_after_decls) {
-                out_ << "\n";
+                out_.Put('\n');
             }
             NewLine();
         }
         GenerateDeclaration(decl);
         first_decl = false;
     }
-    if (!module.name_.empty()) {
+    if (module.name_ != Symbol{}) {
         EndBlock();
     }
 }
 
-void CodeGenerator::GenerateImports(const Imports& imports) {
-    for (auto const& [name, info] : imports.GetImports()) {
-        auto [alias, funcs] = info;
-        out_ << "import " << name;
-        if (name != alias) {
-            out_ << " as " << alias;
-        }
-        if (!funcs.empty()) {
-            out_ << " (";
-            for (auto it = funcs.begin(); it != funcs.end(); ++it) {
-                if (it != funcs.begin()) {
-                    out_ << ", ";
-                }
-                out_ << *it;
+template <OutputSink Sink>
+void CodeGenerator<Sink>::GenerateImports(const Imports& imports) {
+    for (const Import& import : imports.GetImports()) {
+        GenerateImport(import);
+        NewLine();
+    }
+}
+
+template <OutputSink Sink>
+void CodeGenerator<Sink>::GenerateImport(const Import& import) {
+    out_.Write("import ");
+    out_.Write(Name(import.module_));
+    if (import.module_ != import.alias_) {
+        out_.Write(" as ");
+        out_.Write(Name(import.alias_));
+    }
+    const auto& funcs = import.functions_;
+    if (!funcs.empty()) {
+        out_.Write(" (");
+        for (auto it = funcs.begin(); it != funcs.end(); ++it) {
+            if (it != funcs.begin()) {
+                out_.Write(", ");
             }
-            out_ << ")";
+            out_.Write(Name(*it));
         }
-        NewLine();
+        out_.Put(')');
     }
 }
 
-CodeGenerator::DeclarationVisitor::DeclarationVisitor(CodeGenerator& gen)
+template <OutputSink Sink>
+CodeGenerator<Sink>::DeclarationVisitor::DeclarationVisitor(CodeGenerator& gen)
     : gen_(gen) {
 }
 
-void CodeGenerator::DeclarationVisitor::operator()(const Constant& c) {
+template <OutputSink Sink>
+void CodeGenerator<Sink>::DeclarationVisitor::operator()(const Constant& c) {
     gen_.GenerateConstant(c);
 }
 
-void CodeGenerator::DeclarationVisitor::operator()(const Function& f) {
+template <OutputSink Sink>
+void CodeGenerator<Sink>::DeclarationVisitor::operator()(const Function& f) {
     gen_.GenerateFunction(f);
 }
 
-void CodeGenerator::DeclarationVisitor::operator()(const Module& m) {
+template <OutputSink Sink>
+void CodeGenerator<Sink>::DeclarationVisitor::operator()(const Module& m) {
     gen_.GenerateModule(m);
 }
 
-void CodeGenerator::GenerateDeclaration(const Declaration& decl) {
+template <OutputSink Sink>
+void CodeGenerator<Sink>::GenerateDeclaration(const Declaration& decl) {
     std::visit(DeclarationVisitor(*this), decl);
 }
 
-void CodeGenerator::GenerateConstant(const Constant& constant) {
-    out_ << "let " << constant.name_ << " := ";
+template <OutputSink Sink>
+void CodeGenerator<Sink>::GenerateConstant(const Constant& constant) {
+    out_.Write("let ");
+    out_.Write(Name(constant.name_));
+    out_.Write(" := ");
     GenerateExpression(constant.value_);
 }
 
-void CodeGenerator::GenerateFunction(const Function& func) {
-    out_ << "let " << func.name_;
+template <OutputSink Sink>
+void CodeGenerator<Sink>::GenerateFunction(const Function& func) {
+    out_.Write("let ");
+    out_.Write(Name(func.name_));
     if (!func.parameters_.empty()) {
-        out_ << "(" << func.parameters_[0];
+        out_.Put('(');
+        out_.Write(Name(func.parameters_[0]));
         for (auto it = func.parameters_.begin() + 1;
              it != func.parameters_.end(); ++it) {
-            out_ << ", " << *it;
+            out_.Write(", ");
+            out_.Write(Name(*it));
         }
-        out_ << ")";
+        out_.Put(')');
     }
-    out_ << " := ";
+    out_.Write(" := ");
     GenerateExpression(func.value_);
     if (func.body_) {
-        out_ << " where";
+        out_.Write(" where");
         StartBlock();
         GenerateModule(*func.body_);
         EndBlock();
     }
 }
 
-CodeGenerator::ExpressionVisitor::ExpressionVisitor(CodeGenerator& gen,
-                                                    int parent_precedence,
-                                                    Operator parent_operator)
+template <OutputSink Sink>
+CodeGenerator<Sink>::ExpressionVisitor::ExpressionVisitor(
+    CodeGenerator& gen, int parent_precedence, Operator parent_operator)
     : gen_(gen),
       parent_precedence_(parent_precedence),
       parent_operator_(parent_operator) {
 }
 
-void CodeGenerator::ExpressionVisitor::operator()(const UnaryOperation& unop) {
+template <OutputSink Sink>
+void CodeGenerator<Sink>::ExpressionVisitor::operator()(
+    const UnaryOperation& unop) {
     gen_.GenerateUnaryOperation(unop);
 }
 
-void CodeGenerator::ExpressionVisitor::operator()(
+template <OutputSink Sink>
+void CodeGenerator<Sink>::ExpressionVisitor::operator()(
     const BinaryOperation& binop) {
     gen_.GenerateBinaryOperation(binop, parent_precedence_, parent_operator_);
 }
 
-void CodeGenerator::ExpressionVisitor::operator()(const FunctionCall& fc) {
+template <OutputSink Sink>
+void CodeGenerator<Sink>::ExpressionVisitor::operator()(
+    const FunctionCall& fc) {
     gen_.GenerateFunctionCall(fc);
 }
 
-void CodeGenerator::ExpressionVisitor::operator()(const Variable& v) {
+template <OutputSink Sink>
+void CodeGenerator<Sink>::ExpressionVisitor::operator()(const Variable& v) {
     gen_.GenerateVariable(v);
 }
 
-void CodeGenerator::ExpressionVisitor::operator()(const Number& n) {
+template <OutputSink Sink>
+void CodeGenerator<Sink>::ExpressionVisitor::operator()(const Number& n) {
     gen_.GenerateNumber(n);
 }
 
-void CodeGenerator::ExpressionVisitor::operator()(const Float& f) {
+template <OutputSink Sink>
+void CodeGenerator<Sink>::ExpressionVisitor::operator()(const Float& f) {
     gen_.GenerateFloat(f);
 }
 
-void CodeGenerator::GenerateExpression(const Expression& expr,
-                                       int parent_precedence,
+template <OutputSink Sink>
+void CodeGenerator<Sink>::ExpressionVisitor::operator()(
+    const FlatExpression& f) {
+    gen_.PushFlatNode(f.root_, parent_precedence_, parent_operator_);
+}
+
+template <OutputSink Sink>
+void CodeGenerator<Sink>::PushExpression(const Expression& expr,
+                                         int parent_precedence,
+                                         Operator parent_operator) {
+    pending_.push_back({PendingOutput::Kind::EXPRESSION, parent_operator,
+                        parent_precedence, &expr});
+}
+
+template <OutputSink Sink>
+void CodeGenerator<Sink>::PushFlatNode(NodeId node, int parent_precedence,
                                        Operator parent_operator) {
-    std::visit(ExpressionVisitor(*this, parent_precedence, parent_operator),
-               expr);
+    pending_.push_back({PendingOutput::Kind::FLAT_NODE, parent_operator,
+                        parent_precedence, nullptr, node});
 }
 
-void CodeGenerator::GenerateUnaryOperation(const UnaryOperation& unop) {
-    out_ << "-";
-    bool place_brackets = std::holds_alternative<BinaryOperation>(*unop.expr_);
-    if (place_brackets) {
-        out_ << "(";
+template <OutputSink Sink>
+void CodeGenerator<Sink>::PushOperator(Operator op) {
+    pending_.push_back({PendingOutput::Kind::OPERATOR, op});
+}
+
+template <OutputSink Sink>
+void CodeGenerator<Sink>::PushText(const char* text) {
+    pending_.push_back(
+        {PendingOutput::Kind::TEXT, Operator::ROOT, 0, nullptr, 0, text});
+}
+
+template <OutputSink Sink>
+void CodeGenerator<Sink>::Drain(size_t bottom) {
+    while (pending_.size() > bottom) {
+        PendingOutput item = pending_.back();
+        pending_.pop_back();
+        switch (item.kind_) {
+            case PendingOutput::Kind::EXPRESSION:
+                std::visit(ExpressionVisitor(*this, item.parent_precedence_,
+                                             item.operator_),
+                           *item.expr_);
+                break;
+            case PendingOutput::Kind::FLAT_NODE:
+                GenerateFlatNode(item.node_, item.parent_precedence_,
+                                 item.operator_);
+                break;
+            case PendingOutput::Kind::OPERATOR:
+                out_.Put(' ');
+                out_.Write(OperatorRepr(item.operator_));
+                out_.Put(' ');
+                break;
+            case PendingOutput::Kind::TEXT:
+                out_.Write(item.text_);
+                break;
+        }
     }
-    GenerateExpression(*unop.expr_);
+}
+
+template <OutputSink Sink>
+void CodeGenerator<Sink>::GenerateExpression(const Expression& expr,
+                                             int parent_precedence,
+                                             Operator parent_operator) {
+    size_t bottom = pending_.size();
+    PushExpression(expr, parent_precedence, parent_operator);
+    Drain(bottom);
+}
+
+template <OutputSink Sink>
+void CodeGenerator<Sink>::GenerateUnaryOperation(const UnaryOperation& unop) {
+    out_.Put('-');
+    bool place_brackets = std::holds_alternative<BinaryOperation>(*unop.expr_);
     if (place_brackets) {
-        out_ << ")";
+        out_.Put('(');
+        PushText(")");
     }
+    PushExpression(*unop.expr_);
 }
 
-void CodeGenerator::GenerateBinaryOperation(const BinaryOperation& op,
-                                            int parent_precedence,
-                                            Operator parent_operator) {
-    int current_precedence = kOperatorPrecedence.at(op.op_);
+template <OutputSink Sink>
+void CodeGenerator<Sink>::GenerateBinaryOperation(const BinaryOperation& op,
+                                                  int parent_precedence,
+                                                  Operator parent_operator) {
+    int current_precedence = OperatorPrecedence(op.op_);
     bool place_brackets = false;
     if (current_precedence < parent_precedence) {
         bool associative = op.op_ == Operator::ADD || op.op_ == Operator::MUL;
@@ -192,9 +362,6 @@ void CodeGenerator::GenerateBinaryOperation(const BinaryOperation& op,
             place_brackets = true;
         }
     }
-    if (place_brackets) {
-        out_ << "(";
-    }
     int lhs_precedence = current_precedence,
         rhs_precedence = current_precedence;
     if (op.op_ == Operator::POW) {
@@ -202,40 +369,592 @@ void CodeGenerator::GenerateBinaryOperation(const BinaryOperation& op,
     } else {
         ++rhs_precedence;
     }
-    GenerateExpression(*op.lhs_, lhs_precedence, op.op_);
-    out_ << " " << kOperatorRepr.at(op.op_) << " ";
+    // Pushed in reverse: lhs, the operator, rhs, closing brackets.
+    if (place_brackets) {
+        out_.Put('(');
+        PushText(")");
+    }
     if (std::holds_alternative<UnaryOperation>(*op.rhs_)) {
-        out_ << "(";
-        GenerateExpression(*op.rhs_, rhs_precedence, op.op_);
-        out_ << ")";
+        PushText(")");
+        PushExpression(*op.rhs_, rhs_precedence, op.op_);
+        PushText("(");
     } else {
-        GenerateExpression(*op.rhs_, rhs_precedence, op.op_);
+        PushExpression(*op.rhs_, rhs_precedence, op.op_);
     }
-    if (place_brackets) {
-        out_ << ")";
+    PushOperator(op.op_);
+    PushExpression(*op.lhs_, lhs_precedence, op.op_);
+}
+
+template <OutputSink Sink>
+void CodeGenerator<Sink>::GenerateFunctionCall(const FunctionCall& call) {
+    out_.Write(Name(call.name_));
+    out_.Put('(');
+    PushText(")");
+    for (size_t i = call.args_.size(); i-- > 0;) {
+        PushExpression(call.args_[i]);
+        if (i != 0) {
+            PushText(", ");
+        }
     }
 }
 
-void CodeGenerator::GenerateFunctionCall(const FunctionCall& call) {
-    out_ << call.name_ << "(";
-    if (!call.args_.empty()) {
-        GenerateExpression(call.args_[0]);
-        for (auto it = call.args_.begin() + 1; it != call.args_.end(); ++it) {
-            out_ << ", ";
-            GenerateExpression(*it);
+template <OutputSink Sink>
+void CodeGenerator<Sink>::GenerateVariable(const Variable& var) {
+    out_.Write(Name(var.name_));
+}
+
+template <OutputSink Sink>
+void CodeGenerator<Sink>::GenerateNumber(const Number& n) {
+    PrintInteger(n.value_);
+}
+
+template <OutputSink Sink>
+void CodeGenerator<Sink>::GenerateFloat(const Float& f) {
+    PrintFloat(f.value_);
+}
+
+template <OutputSink Sink>
+void CodeGenerator<Sink>::PrintInteger(int64_t value) {
+    char buffer[24];
+    char* end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+    out_.Write(std::string_view(buffer, end - buffer));
+}
+
+template <OutputSink Sink>
+void CodeGenerator<Sink>::PrintFloat(double value) {
+    // The shortest round-trip digits are taken in scientific notation, which
+    // the language has no syntax for, and laid out in fixed notation here.
+    char buffer[32];
+    char* end = std::to_chars(buffer, buffer + sizeof(buffer), value,
+                              std::chars_format::scientific)
+                    .ptr;
+    char* exponent_mark = std::find(buffer, end, 'e');
+    char* exponent_begin = exponent_mark + 1;
+    if (*exponent_begin == '+') {
+        ++exponent_begin;
+    }
+    int exponent = 0;
+    std::from_chars(exponent_begin, end, exponent);
+
+    // Significant digits without the '.' after the first one.
+    char digit_buffer[sizeof(buffer)];
+    size_t digit_count = 0;
+    digit_buffer[digit_count++] = buffer[0];
+    for (char* it = buffer + 2; it < exponent_mark; ++it) {
+        digit_buffer[digit_count++] = *it;
+    }
+    std::string_view digits(digit_buffer, digit_count);
+    if (exponent < 0) {
+        out_.Write("0.");
+        out_.Fill('0', static_cast<size_t>(-exponent - 1));
+        out_.Write(digits);
+        return;
+    }
+    size_t integral = static_cast<size_t>(exponent) + 1;
+    if (digits.size() <= integral) {
+        out_.Write(digits);
+        out_.Fill('0', integral - digits.size());
+        out_.Write(".0");
+        return;
+    }
+    out_.Write(digits.substr(0, integral));
+    out_.Put('.');
+    out_.Write(digits.substr(integral));
+}
+
+template <OutputSink Sink>
+void CodeGenerator<Sink>::GenerateFlatNode(NodeId node, int parent_precedence,
+                                           Operator parent_operator) {
+    const FlatAst& ast = *flat_;
+    switch (ast.GetKind(node)) {
+        case NodeKind::UNARY_OPERATION: {
+            NodeId operand = ast.GetLhs(node);
+            if (ast.GetKind(operand) == NodeKind::BINARY_OPERATION) {
+                out_.Write("-(");
+                PushText(")");
+            } else {
+                out_.Put('-');
+            }
+            PushFlatNode(operand);
+            break;
+        }
+        case NodeKind::BINARY_OPERATION: {
+            Operator op = ast.GetOperator(node);
+            int current_precedence = OperatorPrecedence(op);
+            bool associative = op == Operator::ADD || op == Operator::MUL;
+            bool place_brackets = current_precedence < parent_precedence &&
+                                  !(associative && parent_operator == op);
+            if (place_brackets) {
+                out_.Put('(');
+                PushText(")");
+            }
+            int lhs_precedence = current_precedence + (op == Operator::POW);
+            int rhs_precedence = current_precedence + (op != Operator::POW);
+            NodeId rhs = ast.GetRhs(node);
+            if (ast.GetKind(rhs) == NodeKind::UNARY_OPERATION) {
+                PushText(")");
+                PushFlatNode(rhs, rhs_precedence, op);
+                PushText("(");
+            } else {
+                PushFlatNode(rhs, rhs_precedence, op);
+            }
+            PushOperator(op);
+            PushFlatNode(ast.GetLhs(node), lhs_precedence, op);
+            break;
         }
+        case NodeKind::FUNCTION_CALL: {
+            out_.Write(Name(ast.GetName(node)));
+            out_.Put('(');
+            PushText(")");
+            for (size_t i = ast.GetArgumentCount(node); i-- > 0;) {
+                PushFlatNode(ast.GetArgument(node, i));
+                if (i != 0) {
+                    PushText(", ");
+                }
+            }
+            break;
+        }
+        case NodeKind::VARIABLE:
+            out_.Write(Name(ast.GetName(node)));
+            break;
+        case NodeKind::NUMBER:
+            PrintInteger(ast.GetNumber(node));
+            break;
+        case NodeKind::FLOAT:
+            PrintFloat(ast.GetFloat(node));
+            break;
     }
-    out_ << ")";
 }
 
-void CodeGenerator::GenerateVariable(const Variable& var) {
-    out_ << var.name_;
+template class CodeGenerator<StringSink>;
+template class CodeGenerator<FdSink>;
+template class CodeGenerator<CountingSink>;
+template class CodeGenerator<OStreamSink>;
+template class CodeGenerator<CompareSink>;
+
+namespace {
+
+/**
+ * @brief Marks the end of the last batch, which runs until the file ends.
+ */
+constexpr size_t kNoEnd = SIZE_MAX;
+
+/**
+ * @brief Checks whether the `index`-th token is an `import`, a `let` or a
+ * `module` starting a line.
+ */
+bool StartsTopLevelItem(const TokenBuffer& tokens, size_t index) {
+    const LexedToken& token = tokens[index];
+    if (token.type_ != TokenType::IMPORT && token.type_ != TokenType::LET &&
+        token.type_ != TokenType::MODULE) {
+        return false;
+    }
+    return token.offset_ == 0 ||
+           tokens.GetSource().Data()[token.offset_ - 1] == '\n';
+}
+
+/**
+ * @struct ParsedBatch
+ * @brief Top-level items of a file parsed by one task of `PreformatFile`:
+ * those starting from the `begin_`-th token up to the first one starting at
+ * the `end_`-th token or later.
+ */
+struct ParsedBatch {
+    size_t begin_ = 0;
+    size_t end_ = kNoEnd;
+    size_t stop_ = 0;  // where the first item after the batch starts
+    bool file_ended_ = false;
+    std::exception_ptr error_ = nullptr;
+
+    std::shared_ptr<SymbolTable> symbols_ = nullptr;
+    std::vector<std::optional<Import>> items_;  // nothing for declarations
+    bool has_nonempty_submodule_ = false;
+    std::string text_;
+    std::vector<size_t> declaration_ends_;
+};
+
+/**
+ * @struct SourceLine
+ * @brief Line `[begin_, end_)` of a text, without its end of line, and where
+ * and how wide its indentation ends.
+ */
+struct SourceLine {
+    size_t begin_ = 0;
+    size_t indent_end_ = 0;
+    size_t end_ = 0;
+    size_t width_ = 0;
+
+    bool IsBlank() const {
+        return indent_end_ == end_;
+    }
+};
+
+/**
+ * @brief Gets the line of `text` starting at `begin`, measuring its
+ * indentation the way the tokenizer does.
+ */
+SourceLine GetLine(std::string_view text, size_t begin,
+                   size_t spaces_per_tab) {
+    SourceLine line;
+    line.begin_ = begin;
+    line.end_ = std::min(text.find('\n', begin), text.size());
+    const char* data = text.data();
+    line.indent_end_ = ScanBlanks(data + begin, data + line.end_) - data;
+    size_t tabs = std::count(data + begin, data + line.indent_end_, '\t');
+    line.width_ = line.indent_end_ - begin - tabs + tabs * spaces_per_tab;
+    return line;
 }
 
-void CodeGenerator::GenerateNumber(const Number& n) {
-    out_ << n.value_;
+/**
+ * @brief Finds where the `line`-th line of `text`, counted from 1, starts.
+ * Ends of line are counted a block at a time up to the block holding it,
+ * which is much faster than looking for them one by one.
+ *
+ * @return Returns the offset of the line, or `npos` if there are fewer lines.
+ */
+size_t FindLine(std::string_view text, size_t line) {
+    constexpr size_t kBlockSize = 4096;
+    size_t begin = 0;
+    size_t left = line - 1;  // ends of line between `begin` and the line
+    while (text.size() - begin >= kBlockSize) {
+        const char* block = text.data() + begin;
+        size_t count = std::count(block, block + kBlockSize, '\n');
+        if (count >= left) {
+            break;
+        }
+        left -= count;
+        begin += kBlockSize;
+    }
+    for (; left > 0; --left) {
+        begin = text.find('\n', begin);
+        if (begin == std::string_view::npos) {
+            return begin;
+        }
+        ++begin;
+    }
+    return begin;
+}
+
+/**
+ * @brief Gets the line of `text` before `line`, which must not be the first
+ * one.
+ */
+SourceLine GetPreviousLine(std::string_view text, const SourceLine& line,
+                           size_t spaces_per_tab) {
+    size_t end = line.begin_ - 1;
+    // If there is no end of line before, `npos + 1` wraps around to 0.
+    size_t begin = end == 0 ? 0 : text.rfind('\n', end - 1) + 1;
+    return GetLine(text, begin, spaces_per_tab);
+}
+
+/**
+ * @brief Checks whether one of the lines of `text` in `[begin, end)`, which
+ * both start lines, is indented by `width` and declares a submodule.
+ */
+bool DeclaresSubmodule(std::string_view text, size_t begin, size_t end,
+                       size_t width, size_t spaces_per_tab) {
+    constexpr std::string_view kKeyword = "module";
+    std::string_view searched = text.substr(0, end);
+    for (size_t pos = searched.find(kKeyword, begin);
+         pos != std::string_view::npos;
+         pos = searched.find(kKeyword, pos + 1)) {
+        size_t line_begin = pos == 0 ? 0 : text.rfind('\n', pos - 1) + 1;
+        SourceLine line = GetLine(text, line_begin, spaces_per_tab);
+        size_t after = pos + kKeyword.size();
+        if (line.indent_end_ == pos && line.width_ == width &&
+            (after == text.size() ||
+             !(CharClassOf(static_cast<unsigned char>(text[after])) &
+               kCharWord))) {
+            return true;
+        }
+    }
+    return false;
 }
 
-void CodeGenerator::GenerateFloat(const Float& f) {
-    out_ << f.value_;
+}  // namespace
+
+PreformattedFile PreformatFile(const TokenBuffer& tokens, size_t threads,
+                               size_t min_batch_tokens) {
+    // Declarations are generated right after they are parsed, so batches
+    // only keep their text.
+    auto parse = [&tokens](ParsedBatch& batch) {
+        batch.symbols_ = std::make_shared<SymbolTable>();
+        StringSink sink;
+        CodeGenerator<StringSink> gen(sink);
+        gen.symbols_ = batch.symbols_.get();
+        Arena arena;
+        try {
+            Parser parser(tokens);
+            parser.ShareSymbols(batch.symbols_);
+            parser.SeekToken(batch.begin_);
+            while (true) {
+                // Items are preceded by ends of line and indents, which the
+                // parser skips.
+                size_t next = parser.GetTokenIndex();
+                while (next < tokens.Size() &&
+                       (tokens[next].type_ == TokenType::EOL ||
+                        tokens[next].type_ == TokenType::INDENT)) {
+                    ++next;
+                }
+                batch.stop_ = next;
+                if (next >= batch.end_) {
+                    break;
+                }
+                Imports imports;
+                std::optional<Declaration> decl;
+                if (!parser.ParseNextItem(imports, decl, &arena)) {
+                    batch.file_ended_ = true;
+                    break;
+                }
+                if (!decl) {
+                    batch.items_.push_back(imports.GetImports().front());
+                    continue;
+                }
+                batch.items_.push_back(std::nullopt);
+                if (const Module* submodule = std::get_if<Module>(&*decl)) {
+                    batch.has_nonempty_submodule_ =
+                        batch.has_nonempty_submodule_ ||
+                        !submodule->declarations_.empty() ||
+                        !submodule->imports_.GetImports().empty();
+                }
+                gen.GenerateDeclaration(*decl);
+                batch.declaration_ends_.push_back(sink.View().size());
+                decl.reset();
+                arena.release();
+            }
+        } catch (...) {
+            batch.error_ = std::current_exception();
+        }
+        batch.text_ = sink.Release();
+    };
+
+    std::vector<ParsedBatch> batches(1);
+    min_batch_tokens = std::max<size_t>(min_batch_tokens, 1);
+    size_t count = std::clamp<size_t>(tokens.Size() / min_batch_tokens, 1,
+                                      4 * std::max<size_t>(threads, 1));
+    for (size_t i = 1; i < count; ++i) {
+        size_t split = std::max(batches.back().begin_ + 1,
+                                tokens.Size() / count * i);
+        while (split < tokens.Size() && !StartsTopLevelItem(tokens, split)) {
+            ++split;
+        }
+        if (split >= tokens.Size()) {
+            break;
+        }
+        batches.back().end_ = split;
+        batches.emplace_back().begin_ = split;
+    }
+    ParallelFor(batches.size(), threads,
+                [&parse, &batches](size_t i) { parse(batches[i]); });
+
+    // Batches are chained the way the file would be parsed, imports are
+    // merged in order and the first error is thrown.
+    PreformattedFile file;
+    file.symbols_ = std::make_shared<SymbolTable>();
+    std::deque<ParsedBatch> reparsed;
+    size_t position = 0;
+    size_t next_batch = 0;
+    while (true) {
+        while (next_batch < batches.size() &&
+               batches[next_batch].begin_ < position) {
+            ++next_batch;
+        }
+        ParsedBatch* batch = nullptr;
+        if (next_batch < batches.size() &&
+            batches[next_batch].begin_ == position) {
+            batch = &batches[next_batch];
+        } else {
+            // An item ran over the start of the next batch, which therefore
+            // may not start with an item at all.
+            batch = &reparsed.emplace_back();
+            batch->begin_ = position;
+            if (next_batch < batches.size()) {
+                batch->end_ = batches[next_batch].begin_;
+            }
+            parse(*batch);
+        }
+        const SymbolTable& symbols = *batch->symbols_;
+        auto intern = [&file, &symbols](Symbol symbol) {
+            return file.symbols_->Intern(symbols.GetName(symbol));
+        };
+        for (const std::optional<Import>& item : batch->items_) {
+            if (!item) {
+                continue;
+            }
+            Import import{intern(item->module_), intern(item->alias_), {}};
+            for (Symbol function : item->functions_) {
+                import.functions_.push_back(intern(function));
+            }
+            file.imports_.AddImport(std::move(import), *file.symbols_);
+        }
+        if (batch->error_) {
+            std::rethrow_exception(batch->error_);
+        }
+        file.has_nonempty_submodule_ =
+            file.has_nonempty_submodule_ || batch->has_nonempty_submodule_;
+        file.texts_.push_back(std::move(batch->text_));
+        file.declaration_ends_.push_back(std::move(batch->declaration_ends_));
+        if (batch->file_ended_ || batch->end_ == kNoEnd) {
+            break;
+        }
+        position = batch->stop_;
+    }
+    return file;
+}
+
+TextEdit FormatLines(std::string_view text, size_t spaces_per_tab,
+                     size_t first_line, size_t last_line) {
+    first_line = std::max<size_t>(first_line, 1);
+    size_t begin = FindLine(text, first_line);
+    if (begin == std::string_view::npos) {
+        return {text.size(), 0, {}};
+    }
+
+    // Finds the non-blank lines selected and the least indented of them.
+    std::optional<SourceLine> first;
+    size_t width = SIZE_MAX;
+    size_t content_end = 0;  // end of the last non-blank line formatted
+    size_t end = begin;      // start of the first line not formatted
+    for (size_t line = first_line; line <= last_line && end <= text.size();
+         ++line) {
+        SourceLine current = GetLine(text, end, spaces_per_tab);
+        if (!current.IsBlank()) {
+            first = first.value_or(current);
+            width = std::min(width, current.width_);
+            content_end = current.end_;
+        }
+        end = current.end_ + 1;
+    }
+    if (!first) {
+        return {begin, 0, {}};
+    }
+
+    // The items start at the nearest line that is indented no more than the
+    // selected ones, and are nested in the blocks opened by the lines before
+    // them that are indented less and less.
+    SourceLine start = *first;
+    while ((start.IsBlank() || start.width_ > width) && start.begin_ > 0) {
+        start = GetPreviousLine(text, start, spaces_per_tab);
+    }
+    std::vector<SourceLine> ancestors;  // outermost first
+    size_t block_width = start.width_;
+    for (SourceLine line = start; block_width > 0 && line.begin_ > 0;) {
+        line = GetPreviousLine(text, line, spaces_per_tab);
+        if (!line.IsBlank() && line.width_ < block_width) {
+            ancestors.push_back(line);
+            block_width = line.width_;
+        }
+    }
+    std::reverse(ancestors.begin(), ancestors.end());
+    // Blocks are indented by two spaces in the output, so the items of an
+    // enclosing block are formatted if the indentation differs.
+    while (!ancestors.empty() && start.width_ != 2 * ancestors.size()) {
+        start = ancestors.back();
+        ancestors.pop_back();
+    }
+    if (ancestors.empty() && (start.IsBlank() || start.width_ != 0)) {
+        // Only the first lines of a file that is not valid are indented at
+        // the top level, so it is parsed from the start to report the error.
+        start = GetLine(text, 0, spaces_per_tab);
+        start.width_ = 0;
+    }
+
+    // The last item ends before the next line indented no more than it.
+    while (end < text.size()) {
+        SourceLine line = GetLine(text, end, spaces_per_tab);
+        if (!line.IsBlank()) {
+            if (line.width_ <= start.width_) {
+                break;
+            }
+            content_end = line.end_;
+        }
+        end = line.end_ + 1;
+    }
+    end = std::min(end, text.size());
+
+    // Only the text up to the end of the items is tokenized, starting in the
+    // indentation context of their block.
+    Tokenizer tokenizer(text.substr(0, end), spaces_per_tab);
+    Tokenizer::Checkpoint checkpoint = tokenizer.Save();
+    checkpoint.pos_ = start.begin_;
+    checkpoint.token_begin_ = start.begin_;
+    for (size_t i = 0; i < ancestors.size(); ++i) {
+        size_t inner = i + 1 < ancestors.size() ? ancestors[i + 1].width_
+                                                : start.width_;
+        checkpoint.indents_.push(inner - ancestors[i].width_);
+    }
+    checkpoint.current_indent_spaces_ = start.width_;
+    checkpoint.indentation_level_ = ancestors.size();
+    tokenizer.Restore(checkpoint);
+
+    Arena arena;
+    std::vector<std::optional<Import>> items;  // nothing for declarations
+    std::vector<Declaration> declarations;
+    bool has_nonempty_submodule = false;
+    auto symbols = std::make_shared<SymbolTable>();
+    Parser parser(tokenizer);
+    parser.ShareSymbols(symbols);
+    while (true) {
+        Imports imports;
+        std::optional<Declaration> decl;
+        if (!parser.ParseNextItem(imports, decl, &arena)) {
+            break;
+        }
+        if (!decl) {
+            items.push_back(imports.GetImports().front());
+            continue;
+        }
+        items.push_back(std::nullopt);
+        if (const Module* submodule = std::get_if<Module>(&*decl)) {
+            has_nonempty_submodule = has_nonempty_submodule ||
+                                     !submodule->declarations_.empty() ||
+                                     !submodule->imports_.GetImports().empty();
+        }
+        declarations.push_back(std::move(*decl));
+    }
+
+    // Declarations are separated by blank lines if the block has a submodule,
+    // which is never empty once parsed, anywhere else.
+    if (!has_nonempty_submodule) {
+        size_t block_begin = ancestors.empty() ? 0 : ancestors.back().end_;
+        size_t block_end = text.size();
+        for (size_t pos = end; !ancestors.empty() && pos < text.size();) {
+            SourceLine line = GetLine(text, pos, spaces_per_tab);
+            if (!line.IsBlank() && line.width_ < start.width_) {
+                block_end = line.begin_;
+                break;
+            }
+            pos = line.end_ + 1;
+        }
+        has_nonempty_submodule =
+            DeclaresSubmodule(text, block_begin, start.begin_, start.width_,
+                              spaces_per_tab) ||
+            DeclaresSubmodule(text, end, block_end, start.width_,
+                              spaces_per_tab);
+    }
+
+    StringSink sink;
+    CodeGenerator<StringSink> gen(sink);
+    gen.symbols_ = symbols.get();
+    gen.indent_level_ = ancestors.size();
+    gen.Indent();
+    auto next_declaration = declarations.begin();
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (i > 0) {
+            if (has_nonempty_submodule && !items[i - 1] && !items[i]) {
+                sink.Put('\n');
+            }
+            gen.NewLine();
+        }
+        if (items[i]) {
+            gen.GenerateImport(*items[i]);
+        } else {
+            gen.GenerateDeclaration(*next_declaration++);
+        }
+    }
+    // A block ending with imports is left with an indented blank line, which
+    // is kept as it is in the text instead.
+    std::string formatted = sink.Release();
+    formatted.erase(formatted.find_last_not_of(" \n") + 1);
+    return {start.begin_, content_end - start.begin_, std::move(formatted)};
 }
@@ -0,0 +1,180 @@
+#include <parser/incremental.h>
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+/**
+ * @brief Checks whether tokenizing goes on the same way from two states over
+ * the same text. The values of literals are not compared: they are read from
+ * the text at the same position.
+ */
+bool SameState(const Tokenizer::Checkpoint& lhs,
+               const Tokenizer::Checkpoint& rhs) {
+    return lhs.pos_ == rhs.pos_ && lhs.token_begin_ == rhs.token_begin_ &&
+           lhs.current_type_ == rhs.current_type_ &&
+           lhs.dedents_ == rhs.dedents_ &&
+           lhs.substruct_started_ == rhs.substruct_started_ &&
+           lhs.indents_ == rhs.indents_ &&
+           lhs.current_indent_spaces_ == rhs.current_indent_spaces_ &&
+           lhs.indentation_level_ == rhs.indentation_level_;
+}
+
+/**
+ * @brief Replaces the elements `[begin, end)` of `vector` with those of
+ * `replacement`, moving the elements after them only if the sizes differ.
+ */
+template <class Vector, class Replacement>
+void Splice(Vector& vector, size_t begin, size_t end,
+            Replacement& replacement) {
+    size_t common = std::min(end - begin, replacement.size());
+    auto moved = std::move(replacement.begin(), replacement.begin() + common,
+                           vector.begin() + begin);
+    if (common < end - begin) {
+        vector.erase(moved, vector.begin() + end);
+    } else {
+        vector.insert(moved,
+                      std::make_move_iterator(replacement.begin() + common),
+                      std::make_move_iterator(replacement.end()));
+    }
+}
+
+}  // namespace
+
+IncrementalParser::IncrementalParser(std::string text, size_t spaces_per_tab)
+    : text_(std::move(text)), spaces_per_tab_(spaces_per_tab) {
+    module_.symbols_ = std::make_shared<SymbolTable>();
+}
+
+void IncrementalParser::Edit(size_t offset, size_t length,
+                             std::string_view replacement) {
+    if (offset > text_.size() || length > text_.size() - offset) {
+        throw std::out_of_range("The edited range is out of the text.");
+    }
+    text_.replace(offset, length, replacement);
+
+    // The tokenizer may have looked at the byte right after the current
+    // token, so an item stays valid if that byte is before the edit.
+    auto first_edited = std::partition_point(
+        items_.begin(), items_.begin() + valid_,
+        [offset](const Item& item) { return item.start_.pos_ < offset; });
+    auto tail = std::partition_point(
+        parsed_ ? first_edited : items_.begin() + valid_, items_.end(),
+        [offset, length](const Item& item) {
+            return item.start_.token_begin_ < offset + length;
+        });
+    for (auto it = first_edited; it != tail; ++it) {
+        imports_changed_ = imports_changed_ || it->import_;
+    }
+    for (auto it = tail; it != items_.end(); ++it) {
+        it->start_.pos_ = it->start_.pos_ - length + replacement.size();
+        it->start_.token_begin_ =
+            it->start_.token_begin_ - length + replacement.size();
+    }
+    valid_ = first_edited - items_.begin();
+    items_.erase(first_edited, tail);
+    parsed_ = false;
+}
+
+const Module& IncrementalParser::Parse() {
+    if (parsed_) {
+        return module_;
+    }
+    Tokenizer tokenizer(std::string_view(text_), spaces_per_tab_);
+    Parser parser(tokenizer);
+    parser.ShareSymbols(module_.symbols_);
+    // The last valid item is parsed again, as it may run into the edit.
+    size_t first = valid_ > 0 ? valid_ - 1 : 0;
+    size_t first_declaration = 0;
+    if (valid_ > 0) {
+        tokenizer.Restore(items_[first].start_);
+        first_declaration = items_[first].declarations_;
+    }
+
+    // Imports are merged again in order if any of them was replaced or added,
+    // so that an alias collision is thrown where a full parse would throw it.
+    std::optional<Imports> imports;
+    auto add = [this, &imports](const Item& item) {
+        if (item.import_) {
+            Import import = *item.import_;
+            imports->AddImport(std::move(import), *module_.symbols_);
+        }
+    };
+    auto merge_before = [this, &imports, &add, first] {
+        imports.emplace();
+        std::for_each(items_.begin(), items_.begin() + first, add);
+    };
+
+    std::vector<Item> parsed;
+    std::vector<Declaration> declarations;
+    size_t next = valid_;  // the first item of the last parse not passed yet
+    while (true) {
+        Item item{tokenizer.Save(),
+                  first_declaration + declarations.size()};
+        while (next < items_.size() &&
+               items_[next].start_.token_begin_ < item.start_.token_begin_) {
+            ++next;
+        }
+        if (next < items_.size() &&
+            SameState(items_[next].start_, item.start_)) {
+            break;
+        }
+        Imports item_imports;
+        std::optional<Declaration> decl;
+        bool more = parser.ParseNextItem(item_imports, decl);
+        if (decl) {
+            declarations.push_back(std::move(*decl));
+        } else if (more) {
+            item.import_ = item_imports.GetImports().front();
+            if (!imports) {
+                merge_before();
+            }
+            add(item);
+        }
+        parsed.push_back(std::move(item));
+        if (!more) {
+            next = items_.size();
+            break;
+        }
+    }
+
+    bool imports_changed = imports_changed_;
+    for (size_t i = first; i < next; ++i) {
+        imports_changed = imports_changed || items_[i].import_;
+    }
+    if (imports_changed && !imports) {
+        merge_before();
+    }
+    if (imports) {
+        std::for_each(items_.begin() + next, items_.end(), add);
+    }
+
+    // Nothing throws from here on.
+    size_t end_declaration = next < items_.size()
+                                 ? items_[next].declarations_
+                                 : module_.declarations_.size();
+    Splice(module_.declarations_, first_declaration, end_declaration,
+           declarations);
+    if (declarations.size() != end_declaration - first_declaration) {
+        for (size_t i = next; i < items_.size(); ++i) {
+            items_[i].declarations_ = items_[i].declarations_ -
+                                      end_declaration + first_declaration +
+                                      declarations.size();
+        }
+    }
+    Splice(items_, first, next, parsed);
+    if (imports) {
+        module_.imports_ = std::move(*imports);
+    }
+    valid_ = items_.size();
+    parsed_ = true;
+    imports_changed_ = false;
+    return module_;
+}
+
+std::string_view IncrementalParser::GetText() const {
+    return text_;
+}
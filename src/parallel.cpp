@@ -0,0 +1,112 @@
+#include <parser/parallel.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/**
+ * @struct WorkQueue
+ * @brief Tasks dealt to one thread of `ParallelForStealing`.
+ */
+struct WorkQueue {
+    std::mutex mutex_;
+    std::deque<size_t> tasks_;
+
+    std::optional<size_t> PopFront() {
+        std::lock_guard lock(mutex_);
+        if (tasks_.empty()) {
+            return std::nullopt;
+        }
+        size_t task = tasks_.front();
+        tasks_.pop_front();
+        return task;
+    }
+
+    std::optional<size_t> PopBack() {
+        std::lock_guard lock(mutex_);
+        if (tasks_.empty()) {
+            return std::nullopt;
+        }
+        size_t task = tasks_.back();
+        tasks_.pop_back();
+        return task;
+    }
+};
+
+}  // namespace
+
+void ParallelFor(size_t count, size_t threads,
+                 const std::function<void(size_t)>& task) {
+    std::atomic<size_t> next = 0;
+    std::vector<std::exception_ptr> errors(count);
+    auto work = [&task, &next, &errors, count] {
+        for (size_t i = next++; i < count; i = next++) {
+            try {
+                task(i);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < std::min(threads, count); ++i) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    for (const std::exception_ptr& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+void ParallelForStealing(size_t count, size_t threads,
+                         const std::function<void(size_t)>& task) {
+    threads = std::clamp<size_t>(threads, 1, std::max<size_t>(count, 1));
+    std::vector<WorkQueue> queues(threads);
+    for (size_t i = 0; i < count; ++i) {
+        queues[i % threads].tasks_.push_back(i);
+    }
+    std::vector<std::exception_ptr> errors(count);
+    auto work = [&task, &queues, &errors, threads](size_t self) {
+        while (true) {
+            std::optional<size_t> next = queues[self].PopFront();
+            // No tasks are added while running, so once every queue is found
+            // empty, the thread is done.
+            for (size_t i = 1; !next && i < threads; ++i) {
+                next = queues[(self + i) % threads].PopBack();
+            }
+            if (!next) {
+                return;
+            }
+            try {
+                task(*next);
+            } catch (...) {
+                errors[*next] = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < threads; ++i) {
+        workers.emplace_back(work, i);
+    }
+    work(0);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    for (const std::exception_ptr& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
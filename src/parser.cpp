@@ -1,60 +1,346 @@
 #include <parser/constants.h>
+#include <parser/flat_ast.h>
 #include <parser/parser.h>
 #include <parser/tokenizer.h>
 
+#include <algorithm>
+#include <iterator>
+#include <span>
+#include <type_traits>
+
+namespace {
+
+/**
+ * @class TreeBuilder
+ * @brief Makes the operands of `Parser::ParseExpression` as `Expression`
+ * trees, with nodes allocated in `arena` (on the heap if it is null) and
+ * argument lists from `resource`.
+ */
+class TreeBuilder {
+public:
+    using Operand = Expression;
+
+    TreeBuilder(Arena* arena, std::pmr::memory_resource* resource)
+        : arena_(arena), resource_(resource) {
+    }
+
+    Expression MakeUnary(Expression&& operand) {
+        return UnaryOperation{Operator::SUB,
+                              MakeNode<Expression>(arena_, std::move(operand))};
+    }
+
+    Expression MakeBinary(Expression&& lhs, Operator op, Expression&& rhs,
+                          Operator parent_operator) {
+        auto rhs_node = MakeNode<Expression>(arena_, std::move(rhs));
+        auto lhs_node = MakeNode<Expression>(arena_, std::move(lhs));
+        return BinaryOperation{std::move(lhs_node), op, std::move(rhs_node),
+                               parent_operator};
+    }
+
+    Expression MakeCall(Symbol name, std::span<Expression> arguments) {
+        std::pmr::vector<Expression> args(resource_);
+        args.reserve(arguments.size());
+        std::move(arguments.begin(), arguments.end(),
+                  std::back_inserter(args));
+        return FunctionCall{name, std::move(args)};
+    }
+
+    Expression MakeVariable(Symbol name) {
+        return Variable{name};
+    }
+
+    Expression MakeNumber(int64_t value) {
+        return Number{value};
+    }
+
+    Expression MakeFloat(double value) {
+        return Float{value};
+    }
+
+private:
+    Arena* arena_;
+    std::pmr::memory_resource* resource_;
+};
+
+/**
+ * @class FlatBuilder
+ * @brief Makes the operands of `Parser::ParseExpression` as nodes of a
+ * `FlatAst`. Operands are complete before the operations taking them, so
+ * children are always added before their parents.
+ */
+class FlatBuilder {
+public:
+    using Operand = NodeId;
+
+    explicit FlatBuilder(FlatAst& ast) : ast_(ast) {
+    }
+
+    NodeId MakeUnary(NodeId operand) {
+        return ast_.AddUnaryOperation(Operator::SUB, operand);
+    }
+
+    NodeId MakeBinary(NodeId lhs, Operator op, NodeId rhs, Operator) {
+        return ast_.AddBinaryOperation(lhs, op, rhs);
+    }
+
+    NodeId MakeCall(Symbol name, std::span<NodeId> arguments) {
+        return ast_.AddFunctionCall(name, arguments);
+    }
+
+    NodeId MakeVariable(Symbol name) {
+        return ast_.AddVariable(name);
+    }
+
+    NodeId MakeNumber(int64_t value) {
+        return ast_.AddNumber(value);
+    }
+
+    NodeId MakeFloat(double value) {
+        return ast_.AddFloat(value);
+    }
+
+private:
+    FlatAst& ast_;
+};
+
+}  // namespace
+
 ParserError::ParserError(std::pair<size_t, size_t> coords,
                          const std::string& msg)
     : std::runtime_error("[" + std::to_string(coords.first) + ":" +
-                         std::to_string(coords.second - 1) + "] " + msg) {
-}
-
-void Imports::AddImport(Import import) {
-    auto [module_name, info] = import;
-    auto [alias, functions] = info;
-    if (modules_map_.count(module_name) == 0) {
-        modules_map_[module_name] = {alias, functions};
-    } else {
-        if (modules_map_[module_name].first != alias) {
-            throw std::runtime_error(
-                "Alias collision while importing: tried importing a module `" +
-                module_name + "` with alias `" + alias +
-                "` while same module " +
-                (modules_map_[module_name].first == module_name
-                     ? "without alias"
-                     : "with alias `" + modules_map_[module_name].first + "`") +
-                " has already been imported.");
-        }
-        if (functions.empty()) {
-            modules_map_.erase(modules_map_.find(module_name));
-            modules_map_[module_name].first = alias;
-        } else {
-            if (!modules_map_[module_name].second.empty()) {
-                modules_map_[module_name].second.insert(functions.begin(),
-                                                        functions.end());
-            }
-        }
+                         std::to_string(coords.second - 1) + "] " + msg),
+      coords_(coords),
+      description_(msg) {
+}
+
+std::pair<size_t, size_t> ParserError::GetCoords() const {
+    return coords_;
+}
+
+const std::string& ParserError::GetDescription() const {
+    return description_;
+}
+
+void NodeDeleter<Expression>::operator()(Expression* expr) const {
+    std::vector<Expression*> stack = {expr};
+    while (!stack.empty()) {
+        Expression* current = stack.back();
+        stack.pop_back();
+        // Take the children away before deleting `current`, so that its
+        // destructor has nothing left to recurse into.
+        std::visit(
+            [&stack](auto& node) {
+                using T = std::decay_t<decltype(node)>;
+                if constexpr (std::is_same_v<T, UnaryOperation>) {
+                    if (Expression* child = node.expr_.ReleaseOwned()) {
+                        stack.push_back(child);
+                    }
+                } else if constexpr (std::is_same_v<T, BinaryOperation>) {
+                    if (Expression* child = node.lhs_.ReleaseOwned()) {
+                        stack.push_back(child);
+                    }
+                    if (Expression* child = node.rhs_.ReleaseOwned()) {
+                        stack.push_back(child);
+                    }
+                } else if constexpr (std::is_same_v<T, FunctionCall>) {
+                    // Arguments are stored inline; those that are not leaves
+                    // are moved out to be torn down the same way.
+                    for (auto& arg : node.args_) {
+                        if (std::holds_alternative<UnaryOperation>(arg) ||
+                            std::holds_alternative<BinaryOperation>(arg) ||
+                            std::holds_alternative<FunctionCall>(arg)) {
+                            stack.push_back(new Expression(std::move(arg)));
+                        }
+                    }
+                }
+            },
+            *current);
+        delete current;
     }
 }
 
-const std::map<std::string, std::pair<std::string, std::set<std::string>>>&
-Imports::GetImports() const {
-    return modules_map_;
+Imports::Imports(std::pmr::memory_resource* resource) : imports_(resource) {
 }
 
-Parser::Parser(Tokenizer& tokenizer) : tokenizer_(tokenizer) {
-    tokenizer_.ReadToken();
+void Imports::AddImport(Import&& import, const SymbolTable& symbols) {
+    auto by_name = [&symbols](Symbol lhs, Symbol rhs) {
+        return symbols.GetName(lhs) < symbols.GetName(rhs);
+    };
+    std::pmr::vector<Symbol>& functions = import.functions_;
+    std::sort(functions.begin(), functions.end(), by_name);
+    functions.erase(std::unique(functions.begin(), functions.end()),
+                    functions.end());
+
+    auto it = std::lower_bound(imports_.begin(), imports_.end(),
+                               import.module_,
+                               [&by_name](const Import& entry, Symbol name) {
+                                   return by_name(entry.module_, name);
+                               });
+    if (it == imports_.end() || it->module_ != import.module_) {
+        imports_.insert(it, std::move(import));
+        return;
+    }
+    if (it->alias_ != import.alias_) {
+        std::string name(symbols.GetName(import.module_));
+        throw std::runtime_error(
+            "Alias collision while importing: tried importing a module `" +
+            name + "` with alias `" +
+            std::string(symbols.GetName(import.alias_)) +
+            "` while same module " +
+            (it->alias_ == it->module_
+                 ? "without alias"
+                 : "with alias `" + std::string(symbols.GetName(it->alias_)) +
+                       "`") +
+            " has already been imported.");
+    }
+    std::pmr::vector<Symbol>& current = it->functions_;
+    if (functions.empty()) {
+        current.clear();
+    } else if (!current.empty()) {
+        // Union of two sorted lists, merged in place.
+        size_t middle = current.size();
+        current.insert(current.end(), functions.begin(), functions.end());
+        std::inplace_merge(current.begin(), current.begin() + middle,
+                           current.end(), by_name);
+        current.erase(std::unique(current.begin(), current.end()),
+                      current.end());
+    }
+}
+
+const std::pmr::vector<Import>& Imports::GetImports() const {
+    return imports_;
+}
+
+Module::Module(std::pmr::memory_resource* resource)
+    : imports_(resource), declarations_(resource) {
+}
+
+Parser::Parser(Tokenizer& tokenizer, Allocation allocation)
+    : tokenizer_(&tokenizer), allocation_(allocation) {
+    tokenizer_->ReadToken();
+}
+
+Parser::Parser(const TokenBuffer& tokens, Allocation allocation)
+    : tokens_(&tokens), allocation_(allocation) {
+    if (tokens_->Size() == 0) {
+        throw *tokens_->GetError();
+    }
 }
 
 Module Parser::ParseFile() {
-    return ParseModule();
+    if (allocation_ == Allocation::HEAP) {
+        Module module = ParseModule();
+        module.symbols_ = symbols_;
+        return module;
+    }
+    auto arena = std::make_shared<Arena>();
+    std::shared_ptr<FlatAst> flat = nullptr;
+    if (allocation_ == Allocation::FLAT) {
+        flat = std::make_shared<FlatAst>();
+        flat_ = flat.get();
+    }
+    UseArena(arena.get());
+    Module module = ParseModule();
+    module.arena_ = std::move(arena);
+    module.flat_ = std::move(flat);
+    module.symbols_ = symbols_;
+    UseArena(nullptr);
+    flat_ = nullptr;
+    return module;
+}
+
+std::optional<Declaration> Parser::ParseNextDeclaration(Imports& imports,
+                                                        Arena* arena) {
+    std::optional<Declaration> decl;
+    while (!decl && ParseNextItem(imports, decl, arena)) {
+    }
+    return decl;
+}
+
+bool Parser::ParseNextItem(Imports& imports, std::optional<Declaration>& decl,
+                           Arena* arena) {
+    // Mirrors the loop of `ParseModule` for the file module. Imports are
+    // parsed on the heap, as they outlive the declarations around them.
+    while (true) {
+        switch (CurrentTokenType()) {
+            case TokenType::IMPORT:
+                imports.AddImport(ParseImport(), *symbols_);
+                return true;
+            case TokenType::LET:
+            case TokenType::MODULE:
+                UseArena(arena);
+                try {
+                    if (CurrentTokenType() == TokenType::LET) {
+                        decl.emplace(ParseLet());
+                    } else {
+                        decl.emplace(ParseSubmodule());
+                    }
+                } catch (...) {
+                    // The parser may be resumed, e.g. after `NeedMoreInput`.
+                    UseArena(nullptr);
+                    throw;
+                }
+                UseArena(nullptr);
+                return true;
+            case TokenType::EOL:
+            case TokenType::INDENT:
+                ReadToken();
+                break;
+            case TokenType::FILE_END:
+            case TokenType::DEDENT:
+                return false;
+            default:
+                ThrowError("Unexpected token encountered: `" +
+                           std::string(CurrentTokenLexeme()) + "`.");
+        }
+    }
+}
+
+size_t Parser::GetTokenIndex() const {
+    return index_;
+}
+
+void Parser::SeekToken(size_t index) {
+    index_ = index;
+}
+
+FileOutline Parser::ParseOutline() {
+    FileOutline outline;
+    Arena arena;
+    while (true) {
+        std::optional<Declaration> decl =
+            ParseNextDeclaration(outline.imports_, &arena);
+        if (!decl) {
+            break;
+        }
+        if (const Module* submodule = std::get_if<Module>(&*decl)) {
+            outline.has_nonempty_submodule_ =
+                outline.has_nonempty_submodule_ ||
+                !submodule->declarations_.empty() ||
+                !submodule->imports_.GetImports().empty();
+        }
+        // The declaration has to go before the memory it lives in.
+        decl.reset();
+        arena.release();
+    }
+    outline.symbols_ = symbols_;
+    return outline;
+}
+
+void Parser::ShareSymbols(std::shared_ptr<SymbolTable> symbols) {
+    symbols_ = std::move(symbols);
+}
+
+void Parser::UseFlatAst(FlatAst* flat) {
+    flat_ = flat;
 }
 
 Module Parser::ParseModule() {
-    Module module;
+    Module module(resource_);
     while (true) {
         switch (CurrentTokenType()) {
             case TokenType::IMPORT:
-                module.imports_.AddImport(ParseImport());
+                module.imports_.AddImport(ParseImport(), *symbols_);
                 break;
             case TokenType::LET:
                 module.declarations_.push_back(ParseLet());
@@ -64,246 +350,367 @@ Module Parser::ParseModule() {
                 break;
             case TokenType::EOL:
             case TokenType::INDENT:
-                tokenizer_.ReadToken();
+                ReadToken();
                 break;
             case TokenType::FILE_END:
             case TokenType::DEDENT:
                 return module;
             default:
                 ThrowError("Unexpected token encountered: `" +
-                           CurrentTokenLexeme() + "`.");
+                           std::string(CurrentTokenLexeme()) + "`.");
         }
     }
 }
 
+void Parser::UseArena(Arena* arena) {
+    arena_ = arena;
+    resource_ = arena != nullptr ? arena : std::pmr::get_default_resource();
+}
+
 void Parser::ThrowError(const std::string& msg) {
-    throw ParserError(tokenizer_.GetCoords(), msg);
+    throw ParserError(CurrentCoords(), msg);
 }
 
-Token Parser::CurrentToken() const {
-    return tokenizer_.GetToken();
+void Parser::ReadToken(TokenType expected) {
+    if (tokenizer_) {
+        tokenizer_->ReadToken(expected);
+        return;
+    }
+    if (index_ + 1 < tokens_->Size()) {
+        ++index_;
+    } else if (tokens_->GetError()) {
+        // Tokenization stopped right after the current token.
+        throw *tokens_->GetError();
+    }
+    if (expected != TokenType::NONE && CurrentTokenType() != expected) {
+        throw TokenizerError(
+            CurrentCoords(),
+            UnexpectedTokenMessage(expected, CurrentTokenType()));
+    }
 }
 
 TokenType Parser::CurrentTokenType() const {
-    return CurrentToken().GetType();
+    return tokens_ ? (*tokens_)[index_].type_ : tokenizer_->GetTokenType();
 }
 
-std::string Parser::CurrentTokenLexeme() const {
-    return CurrentToken().GetLexeme();
+std::string_view Parser::CurrentTokenLexeme() const {
+    return tokens_ ? tokens_->GetLexeme(index_) : tokenizer_->GetTokenLexeme();
+}
+
+int64_t Parser::CurrentTokenInteger() const {
+    return tokens_ ? tokens_->GetInteger(index_)
+                   : tokenizer_->GetTokenInteger();
+}
+
+double Parser::CurrentTokenFloat() const {
+    return tokens_ ? tokens_->GetFloat(index_) : tokenizer_->GetTokenFloat();
+}
+
+std::pair<size_t, size_t> Parser::CurrentCoords() const {
+    return ResolvePosition(CurrentPosition());
+}
+
+size_t Parser::CurrentPosition() const {
+    return tokens_ ? tokens_->GetPosition(index_) : tokenizer_->GetPosition();
+}
+
+std::pair<size_t, size_t> Parser::ResolvePosition(size_t position) const {
+    const Source& source =
+        tokens_ ? tokens_->GetSource() : tokenizer_->GetSource();
+    return source.GetCoords(position);
 }
 
 void Parser::ExpectType(TokenType type) {
-    if (CurrentToken().GetType() != type) {
+    if (CurrentTokenType() != type) {
         ThrowError("Unexpected token encountered: expected " +
-                   kTokenName.at(type) + ", got " + CurrentTokenLexeme() + ".");
+                   std::string(TokenName(type)) + ", got " +
+                   std::string(CurrentTokenLexeme()) + ".");
     }
 }
 
 Import Parser::ParseImport() {
-    tokenizer_.ReadToken(TokenType::IDENTIFIER);
-    Imports imports;
-    std::string module_name = ParseName();
-    std::string alias = module_name;
+    ReadToken(TokenType::IDENTIFIER);
+    Symbol module_name = ParseName();
+    Symbol alias = module_name;
     if (CurrentTokenType() == TokenType::AS) {
-        tokenizer_.ReadToken(TokenType::IDENTIFIER);
+        ReadToken(TokenType::IDENTIFIER);
         alias = ParseName();
     }
-    std::set<std::string> functions;
+    std::pmr::vector<Symbol> functions(resource_);
     if (CurrentTokenType() == TokenType::L_BRACKET) {
         functions = ParseImportFunctions();
         ExpectType(TokenType::R_BRACKET);
-        tokenizer_.ReadToken(TokenType::EOL);
+        ReadToken(TokenType::EOL);
     }
-    tokenizer_.ReadToken();
-    return {module_name, {alias, functions}};
+    ReadToken();
+    return {module_name, alias, std::move(functions)};
 }
 
 Declaration Parser::ParseLet() {
-    tokenizer_.ReadToken(TokenType::IDENTIFIER);
-    std::string name = CurrentTokenLexeme();
-    tokenizer_.ReadToken();
+    ReadToken(TokenType::IDENTIFIER);
+    Symbol name = symbols_->Intern(CurrentTokenLexeme());
+    ReadToken();
 
-    std::vector<std::string> parameters;
+    std::pmr::vector<Symbol> parameters(resource_);
     if (CurrentTokenType() == TokenType::L_BRACKET) {
-        tokenizer_.ReadToken();
+        ReadToken();
         while (CurrentTokenType() != TokenType::R_BRACKET) {
             ExpectType(TokenType::IDENTIFIER);
-            parameters.push_back(CurrentTokenLexeme());
-            tokenizer_.ReadToken();
+            parameters.push_back(symbols_->Intern(CurrentTokenLexeme()));
+            ReadToken();
             if (CurrentTokenType() == TokenType::COMMA) {
-                tokenizer_.ReadToken();
+                ReadToken();
             }
         }
-        tokenizer_.ReadToken();
+        ReadToken();
     }
     ExpectType(TokenType::ASSIGN);
-    tokenizer_.ReadToken();
+    ReadToken();
     Expression value = ParseExpression();
     std::unique_ptr<Module> body = nullptr;
     if (CurrentTokenType() == TokenType::WHERE) {
-        tokenizer_.ReadToken();
+        ReadToken();
         body = std::make_unique<Module>(ParseModule());
     }
-    tokenizer_.ReadToken();
+    ReadToken();
     return parameters.empty()
                ? Declaration(Constant{name, std::move(value)})
-               : Declaration(Function{name, parameters, std::move(value),
-                                      std::move(body)});
+               : Declaration(Function{name, std::move(parameters),
+                                      std::move(value), std::move(body)});
 }
 
 Module Parser::ParseSubmodule() {
-    auto [start_line, start_col] = tokenizer_.GetCoords();
-    tokenizer_.ReadToken(TokenType::IDENTIFIER);
-    std::string submodule_name = CurrentTokenLexeme();
-    tokenizer_.ReadToken(TokenType::WHERE);
-    tokenizer_.ReadToken();
+    size_t start = CurrentPosition();
+    ReadToken(TokenType::IDENTIFIER);
+    Symbol submodule_name = symbols_->Intern(CurrentTokenLexeme());
+    ReadToken(TokenType::WHERE);
+    ReadToken();
     if (CurrentTokenType() == TokenType::EOL) {
-        tokenizer_.ReadToken();
+        ReadToken();
     }
     if (CurrentTokenType() != TokenType::INDENT) {
         ThrowError(
             "Expected an indent after substructure declaration "
             "that started at line " +
-            std::to_string(start_line) + ".");
+            std::to_string(ResolvePosition(start).first) + ".");
     }
-    tokenizer_.ReadToken();
+    ReadToken();
     Module submodule = ParseModule();
     if (CurrentTokenType() != TokenType::DEDENT &&
         CurrentTokenType() != TokenType::FILE_END) {
         ThrowError(
             "Expected a dedent after a substructure body that "
             "started at line " +
-            std::to_string(start_line) + ".");
+            std::to_string(ResolvePosition(start).first) + ".");
     }
     submodule.name_ = submodule_name;
-    tokenizer_.ReadToken();
+    ReadToken();
     return submodule;
 }
 
-const std::string Parser::ParseName() {
-    std::string name = CurrentTokenLexeme();
-    tokenizer_.ReadToken();
+Symbol Parser::ParseName() {
+    std::string_view first = CurrentTokenLexeme();
+    ReadToken();
+    if (CurrentTokenType() != TokenType::DOT) {
+        return symbols_->Intern(first);
+    }
+    std::string name(first);
     while (CurrentTokenType() == TokenType::DOT) {
         name.append(CurrentTokenLexeme());
-        tokenizer_.ReadToken(TokenType::IDENTIFIER);
+        ReadToken(TokenType::IDENTIFIER);
         name.append(CurrentTokenLexeme());
-        tokenizer_.ReadToken();
+        ReadToken();
     }
-    return name;
+    return symbols_->Intern(name);
 }
 
-std::set<std::string> Parser::ParseImportFunctions() {
-    tokenizer_.ReadToken(TokenType::IDENTIFIER);
-    std::set<std::string> functions = {CurrentTokenLexeme()};
-    tokenizer_.ReadToken();
+std::pmr::vector<Symbol> Parser::ParseImportFunctions() {
+    ReadToken(TokenType::IDENTIFIER);
+    std::pmr::vector<Symbol> functions(resource_);
+    functions.push_back(symbols_->Intern(CurrentTokenLexeme()));
+    ReadToken();
 
     while (CurrentTokenType() == TokenType::COMMA) {
-        tokenizer_.ReadToken(TokenType::IDENTIFIER);
-        functions.insert(CurrentTokenLexeme());
-        tokenizer_.ReadToken();
+        ReadToken(TokenType::IDENTIFIER);
+        functions.push_back(symbols_->Intern(CurrentTokenLexeme()));
+        ReadToken();
     }
     return functions;
 }
 
 Expression Parser::ParseExpression() {
-    return ParseAddSub(Operator::ROOT);
-}
-
-Expression Parser::ParseAddSub(Operator parent_operator) {
-    auto lhs = ParseMulDiv(parent_operator);
-    while (CurrentTokenType() == TokenType::ADD ||
-           CurrentTokenType() == TokenType::SUB) {
-        auto op = CurrentTokenType() == TokenType::ADD ? Operator::ADD
-                                                       : Operator::SUB;
-        tokenizer_.ReadToken();
-        auto rhs = ParseMulDiv(op);
-        lhs = BinaryOperation{std::make_unique<Expression>(std::move(lhs)), op,
-                              std::make_unique<Expression>(std::move(rhs)),
-                              parent_operator};
-    }
-    return lhs;
-}
-
-Expression Parser::ParseMulDiv(Operator parent_operator) {
-    auto lhs = ParsePow(parent_operator);
-    while (CurrentTokenType() == TokenType::MUL ||
-           CurrentTokenType() == TokenType::DIV) {
-        auto op = CurrentTokenType() == TokenType::MUL ? Operator::MUL
-                                                       : Operator::DIV;
-        tokenizer_.ReadToken();
-        auto rhs = ParsePow(op);
-        lhs = BinaryOperation{std::make_unique<Expression>(std::move(lhs)), op,
-                              std::make_unique<Expression>(std::move(rhs)),
-                              parent_operator};
-    }
-    return lhs;
-}
-
-Expression Parser::ParseUnary(Operator parent_operator) {
-    if (CurrentTokenType() == TokenType::SUB) {
-        tokenizer_.ReadToken();
-        Expression expr = ParseUnary(parent_operator);
-        return UnaryOperation{Operator::SUB,
-                              std::make_unique<Expression>(std::move(expr))};
+    if (flat_) {
+        FlatBuilder builder(*flat_);
+        return FlatExpression{ParseExpression(builder)};
     }
-    return ParseAtom();
+    TreeBuilder builder(arena_, resource_);
+    return ParseExpression(builder);
 }
 
-Expression Parser::ParsePow(Operator parent_operator) {
-    auto lhs = ParseUnary(parent_operator);
-    while (CurrentTokenType() == TokenType::POW) {
-        tokenizer_.ReadToken();
-        auto rhs = ParseAtom();
-        lhs = BinaryOperation{
-            std::make_unique<Expression>(std::move(lhs)), Operator::POW,
-            std::make_unique<Expression>(std::move(rhs)), parent_operator};
+template <class Builder>
+typename Builder::Operand Parser::ParseExpression(Builder& builder) {
+    std::vector<typename Builder::Operand> operands;
+    std::vector<PendingOperator> operators;
+    bool allow_unary = true;
+    while (true) {
+        if (!ParseOperand(allow_unary, builder, operands, operators)) {
+            allow_unary = true;
+            continue;
+        }
+        // An operand is complete: continue with whatever follows it until
+        // another operand is required.
+        while (true) {
+            // An unary minus binds tighter than any binary operator.
+            while (!operators.empty() &&
+                   operators.back().kind_ == PendingOperator::Kind::UNARY) {
+                operands.back() =
+                    builder.MakeUnary(std::move(operands.back()));
+                operators.pop_back();
+            }
+            std::optional<Operator> op;
+            switch (CurrentTokenType()) {
+                case TokenType::ADD:
+                    op = Operator::ADD;
+                    break;
+                case TokenType::SUB:
+                    op = Operator::SUB;
+                    break;
+                case TokenType::MUL:
+                    op = Operator::MUL;
+                    break;
+                case TokenType::DIV:
+                    op = Operator::DIV;
+                    break;
+                case TokenType::POW:
+                    op = Operator::POW;
+                    break;
+                default:
+                    break;
+            }
+            if (op) {
+                // All binary operators are left-associative.
+                int precedence = OperatorPrecedence(*op);
+                while (!operators.empty() &&
+                       operators.back().kind_ ==
+                           PendingOperator::Kind::BINARY &&
+                       OperatorPrecedence(operators.back().op_) >=
+                           precedence) {
+                    ReduceBinary(builder, operands, operators);
+                }
+                operators.push_back({PendingOperator::Kind::BINARY, *op});
+                ReadToken();
+                // The right operand of `^` is an atom.
+                allow_unary = *op != Operator::POW;
+                break;
+            }
+
+            // The innermost expression ends here.
+            while (!operators.empty() &&
+                   operators.back().kind_ == PendingOperator::Kind::BINARY) {
+                ReduceBinary(builder, operands, operators);
+            }
+            if (operators.empty()) {
+                return std::move(operands.back());
+            }
+            if (operators.back().kind_ == PendingOperator::Kind::BRACKET) {
+                ExpectType(TokenType::R_BRACKET);
+                ReadToken();
+                operators.pop_back();
+                continue;
+            }
+            // It is an argument of a call. Arguments may be separated by
+            // commas, a trailing one is allowed.
+            if (CurrentTokenType() == TokenType::COMMA) {
+                ReadToken();
+            }
+            if (CurrentTokenType() != TokenType::R_BRACKET) {
+                allow_unary = true;
+                break;
+            }
+            ReadToken();
+            PendingOperator call = operators.back();
+            operators.pop_back();
+            auto arguments = std::span(operands).subspan(call.first_argument_);
+            auto result = builder.MakeCall(call.name_, arguments);
+            operands.erase(operands.begin() + call.first_argument_,
+                           operands.end());
+            operands.push_back(std::move(result));
+        }
     }
-    return lhs;
 }
 
-Expression Parser::ParseAtom() {
+template <class Builder>
+bool Parser::ParseOperand(bool allow_unary, Builder& builder,
+                          std::vector<typename Builder::Operand>& operands,
+                          std::vector<PendingOperator>& operators) {
     TokenType ctt = CurrentTokenType();
     switch (ctt) {
+        case TokenType::SUB:
+            if (!allow_unary) {
+                break;
+            }
+            ReadToken();
+            operators.push_back({PendingOperator::Kind::UNARY, Operator::SUB});
+            return false;
         case TokenType::IDENTIFIER: {
-            std::string name = ParseName();
+            Symbol name = ParseName();
 
             if (CurrentTokenType() == TokenType::L_BRACKET) {
-                tokenizer_.ReadToken();
-                std::vector<Expression> args;
-                while (CurrentTokenType() != TokenType::R_BRACKET) {
-                    args.push_back(ParseExpression());
-                    if (CurrentTokenType() == TokenType::COMMA) {
-                        tokenizer_.ReadToken();
-                    }
+                ReadToken();
+                if (CurrentTokenType() != TokenType::R_BRACKET) {
+                    operators.push_back({PendingOperator::Kind::CALL,
+                                         Operator::ROOT, name,
+                                         operands.size()});
+                    return false;
                 }
-                tokenizer_.ReadToken();
-                return FunctionCall{name, std::move(args)};
+                ReadToken();
+                operands.push_back(builder.MakeCall(name, {}));
             } else {
-                return Variable{name};
+                operands.push_back(builder.MakeVariable(name));
             }
+            return true;
         }
         case TokenType::INTEGER: {
-            int value = std::stoi(CurrentTokenLexeme());
-            tokenizer_.ReadToken();
-            return Number{value};
+            int64_t value = CurrentTokenInteger();
+            ReadToken();
+            operands.push_back(builder.MakeNumber(value));
+            return true;
         }
         case TokenType::FLOAT: {
-            float value = std::stof(CurrentTokenLexeme());
-            tokenizer_.ReadToken();
-            return Float{value};
-        }
-        case TokenType::L_BRACKET: {
-            tokenizer_.ReadToken();
-            auto expr = ParseExpression();
-            ExpectType(TokenType::R_BRACKET);
-            tokenizer_.ReadToken();
-            return expr;
+            double value = CurrentTokenFloat();
+            ReadToken();
+            operands.push_back(builder.MakeFloat(value));
+            return true;
         }
+        case TokenType::L_BRACKET:
+            ReadToken();
+            operators.push_back({PendingOperator::Kind::BRACKET});
+            return false;
         default:
-            ThrowError("Unexpected token in expression encountered: got `" +
-                       CurrentTokenLexeme() +
-                       "`, expected an identifier, a number, a bracket "
-                       "enclosed expression.");
+            break;
     }
-    return Expression{};
+    ThrowError("Unexpected token in expression encountered: got `" +
+               std::string(CurrentTokenLexeme()) +
+               "`, expected an identifier, a number, a bracket "
+               "enclosed expression.");
+    return false;
+}
+
+template <class Builder>
+void Parser::ReduceBinary(Builder& builder,
+                          std::vector<typename Builder::Operand>& operands,
+                          std::vector<PendingOperator>& operators) {
+    Operator op = operators.back().op_;
+    operators.pop_back();
+    // The operation is a part of the operand that follows the binary operator
+    // below it, if there is one.
+    Operator parent_operator =
+        !operators.empty() &&
+                operators.back().kind_ == PendingOperator::Kind::BINARY
+            ? operators.back().op_
+            : Operator::ROOT;
+    auto rhs = std::move(operands.back());
+    operands.pop_back();
+    operands.back() = builder.MakeBinary(std::move(operands.back()), op,
+                                         std::move(rhs), parent_operator);
 }
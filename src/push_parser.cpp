@@ -0,0 +1,63 @@
+#include <parser/flat_ast.h>
+#include <parser/push_parser.h>
+
+#include <utility>
+
+PushParser::PushParser(size_t spaces_per_tab, Allocation allocation)
+    : tokenizer_(spaces_per_tab),
+      allocation_(allocation),
+      checkpoint_(tokenizer_.Save()),
+      arena_(allocation != Allocation::HEAP ? std::make_shared<Arena>()
+                                            : nullptr),
+      module_(arena_ ? arena_.get() : std::pmr::get_default_resource()) {
+    module_.arena_ = arena_;
+    module_.symbols_ = std::make_shared<SymbolTable>();
+    if (allocation == Allocation::FLAT) {
+        module_.flat_ = std::make_shared<FlatAst>();
+    }
+}
+
+void PushParser::Feed(std::string_view chunk) {
+    if (done_) {
+        // Like `Parser::ParseFile`, ignores whatever follows the file module.
+        return;
+    }
+    tokenizer_.Feed(chunk);
+    if (tokenizer_.GetReadableSize() - checkpoint_.pos_ >= retry_size_) {
+        Advance();
+    }
+}
+
+Module PushParser::Finish() {
+    tokenizer_.Finish();
+    Advance();
+    return std::move(module_);
+}
+
+void PushParser::Advance() {
+    if (done_) {
+        return;
+    }
+    try {
+        if (!parser_) {
+            parser_.emplace(tokenizer_, allocation_);
+            parser_->ShareSymbols(module_.symbols_);
+            parser_->UseFlatAst(module_.flat_.get());
+            checkpoint_ = tokenizer_.Save();
+        }
+        std::optional<Declaration> decl;
+        while (parser_->ParseNextItem(module_.imports_, decl, arena_.get())) {
+            if (decl) {
+                module_.declarations_.push_back(std::move(*decl));
+                decl.reset();
+            }
+            checkpoint_ = tokenizer_.Save();
+        }
+        done_ = true;
+    } catch (const NeedMoreInput&) {
+        // Whatever the interrupted item allocated in the arena or the flat
+        // tree stays there until the module is freed.
+        tokenizer_.Restore(checkpoint_);
+        retry_size_ = 2 * (tokenizer_.GetReadableSize() - checkpoint_.pos_);
+    }
+}
@@ -0,0 +1,158 @@
+#include <parser/scanner.h>
+
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PARSER_HAS_X86_SIMD 1
+#endif
+
+namespace {
+
+/**
+ * @brief A set of scanning functions for one instruction set. All of them
+ * return the first position in `[begin, end)` outside of some class.
+ */
+struct ScanFunctions {
+    const char *(*word_)(const char *, const char *);
+    const char *(*digits_)(const char *, const char *);
+    const char *(*blanks_)(const char *, const char *);
+};
+
+template <uint8_t Class>
+const char *ScanScalar(const char *begin, const char *end) {
+    while (begin != end && (CharClassOf(static_cast<unsigned char>(*begin)) &
+                            Class) != 0) {
+        ++begin;
+    }
+    return begin;
+}
+
+#if PARSER_HAS_X86_SIMD
+// The vector code relies on signed byte comparisons; all the classes are
+// ASCII, so bytes >= 0x80 (negative when signed) never fall into a range.
+
+__attribute__((target("sse2"))) inline __m128i InRange16(__m128i chars,
+                                                          char low,
+                                                          char high) {
+    return _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8(low - 1)),
+                         _mm_cmpgt_epi8(_mm_set1_epi8(high + 1), chars));
+}
+
+__attribute__((target("sse2"))) inline __m128i Classify16(__m128i chars,
+                                                          uint8_t cls) {
+    if (cls == kCharWord) {
+        __m128i lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+        return _mm_or_si128(
+            _mm_or_si128(InRange16(chars, '0', '9'),
+                         InRange16(lower, 'a', 'z')),
+            _mm_cmpeq_epi8(chars, _mm_set1_epi8('_')));
+    }
+    if (cls == kCharDigit) {
+        return InRange16(chars, '0', '9');
+    }
+    // Blanks: ' ' and '\t'..'\r' except '\n'.
+    return _mm_andnot_si128(
+        _mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')),
+        _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8(' ')),
+                     InRange16(chars, '\t', '\r')));
+}
+
+template <uint8_t Class>
+__attribute__((target("sse2"))) const char *ScanSse2(const char *begin,
+                                                     const char *end) {
+    while (end - begin >= 16) {
+        __m128i chars =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+        unsigned mask = ~static_cast<unsigned>(
+                            _mm_movemask_epi8(Classify16(chars, Class))) &
+                        0xFFFFu;
+        if (mask != 0) {
+            return begin + __builtin_ctz(mask);
+        }
+        begin += 16;
+    }
+    return ScanScalar<Class>(begin, end);
+}
+
+__attribute__((target("avx2"))) inline __m256i InRange32(__m256i chars,
+                                                          char low,
+                                                          char high) {
+    return _mm256_and_si256(
+        _mm256_cmpgt_epi8(chars, _mm256_set1_epi8(low - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8(high + 1), chars));
+}
+
+__attribute__((target("avx2"))) inline __m256i Classify32(__m256i chars,
+                                                          uint8_t cls) {
+    if (cls == kCharWord) {
+        __m256i lower = _mm256_or_si256(chars, _mm256_set1_epi8(0x20));
+        return _mm256_or_si256(
+            _mm256_or_si256(InRange32(chars, '0', '9'),
+                            InRange32(lower, 'a', 'z')),
+            _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('_')));
+    }
+    if (cls == kCharDigit) {
+        return InRange32(chars, '0', '9');
+    }
+    return _mm256_andnot_si256(
+        _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\n')),
+        _mm256_or_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8(' ')),
+                        InRange32(chars, '\t', '\r')));
+}
+
+template <uint8_t Class>
+__attribute__((target("avx2"))) const char *ScanAvx2(const char *begin,
+                                                     const char *end) {
+    while (end - begin >= 32) {
+        __m256i chars =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin));
+        uint32_t mask = ~static_cast<uint32_t>(
+            _mm256_movemask_epi8(Classify32(chars, Class)));
+        if (mask != 0) {
+            return begin + __builtin_ctz(mask);
+        }
+        begin += 32;
+    }
+    return ScanSse2<Class>(begin, end);
+}
+#endif
+
+ScanFunctions SelectScanFunctions() {
+#if PARSER_HAS_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {ScanAvx2<kCharWord>, ScanAvx2<kCharDigit>,
+                ScanAvx2<kCharBlank>};
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return {ScanSse2<kCharWord>, ScanSse2<kCharDigit>,
+                ScanSse2<kCharBlank>};
+    }
+#endif
+    return {ScanScalar<kCharWord>, ScanScalar<kCharDigit>,
+            ScanScalar<kCharBlank>};
+}
+
+/**
+ * @brief Gets the scan functions for this CPU, selected on first use so that
+ * tokenizers used while other globals are initialized find them too.
+ */
+const ScanFunctions &GetScanFunctions() {
+    static const ScanFunctions kScanFunctions = SelectScanFunctions();
+    return kScanFunctions;
+}
+
+}  // namespace
+
+const char *ScanWord(const char *begin, const char *end) {
+    return GetScanFunctions().word_(begin, end);
+}
+
+const char *ScanDigits(const char *begin, const char *end) {
+    return GetScanFunctions().digits_(begin, end);
+}
+
+const char *ScanBlanks(const char *begin, const char *end) {
+    return GetScanFunctions().blanks_(begin, end);
+}
@@ -0,0 +1,172 @@
+#include <parser/sink.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define PARSER_HAS_MKSTEMP 1
+#else
+#include <io.h>
+#define close _close
+#define open _open
+#define write _write
+#endif
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+FdSink::FdSink(int fd) : fd_(fd), buffer_(new char[kBufferSize]) {
+}
+
+FdSink::FdSink(const std::string& path)
+    : fd_(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)),
+      owns_fd_(true),
+      buffer_(new char[kBufferSize]) {
+    if (fd_ < 0) {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+}
+
+FdSink::~FdSink() {
+    try {
+        Flush();
+    } catch (const std::system_error&) {
+    }
+    if (owns_fd_) {
+        close(fd_);
+    }
+}
+
+void FdSink::Fill(char c, size_t count) {
+    while (count > 0) {
+        if (used_ == kBufferSize) {
+            Flush();
+        }
+        size_t chunk = std::min(count, kBufferSize - used_);
+        std::fill_n(buffer_.get() + used_, chunk, c);
+        used_ += chunk;
+        count -= chunk;
+    }
+}
+
+void FdSink::Flush() {
+    // The buffer is emptied even if writing fails, so that the destructor
+    // does not retry.
+    size_t used = std::exchange(used_, 0);
+    WriteAll(std::string_view(buffer_.get(), used));
+}
+
+void FdSink::WriteSlow(std::string_view text) {
+    Flush();
+    if (text.size() >= kBufferSize) {
+        WriteAll(text);
+        return;
+    }
+    text.copy(buffer_.get(), text.size());
+    used_ = text.size();
+}
+
+void FdSink::WriteAll(std::string_view text) {
+    while (!text.empty()) {
+        auto written = write(fd_, text.data(), text.size());
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(),
+                                    "Failed to write the output");
+        }
+        text.remove_prefix(static_cast<size_t>(written));
+    }
+}
+
+void ReplaceFile(const std::string& path,
+                 const std::function<void(FdSink&)>& generate) {
+    namespace fs = std::filesystem;
+    std::string target =
+        fs::is_symlink(path) ? fs::canonical(path).string() : path;
+    struct stat info;
+    if (stat(target.c_str(), &info) != 0) {
+        throw std::system_error(errno, std::generic_category(), target);
+    }
+#if PARSER_HAS_MKSTEMP
+    std::string temp = target + ".XXXXXX";
+    int fd = mkstemp(temp.data());
+    if (fd >= 0 && fchmod(fd, info.st_mode & 07777) != 0) {
+        int error = errno;
+        close(fd);
+        unlink(temp.c_str());
+        throw std::system_error(error, std::generic_category(), temp);
+    }
+#else
+    std::string temp = target + ".tmp";
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  info.st_mode);
+#endif
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), temp);
+    }
+    try {
+        {
+            FdSink sink(fd);
+            generate(sink);
+            sink.Flush();
+        }
+        if (close(fd) != 0) {
+            fd = -1;
+            throw std::system_error(errno, std::generic_category(), temp);
+        }
+        fd = -1;
+        fs::rename(temp, target);
+    } catch (...) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        std::error_code error;
+        fs::remove(temp, error);
+        throw;
+    }
+}
+
+OutputMismatch::OutputMismatch(size_t offset) : offset_(offset) {
+}
+
+const char* OutputMismatch::what() const noexcept {
+    return "The output differs from the expected text";
+}
+
+size_t OutputMismatch::GetOffset() const {
+    return offset_;
+}
+
+void CompareSink::Fill(char c, size_t count) {
+    std::string_view expected = expected_.substr(pos_, count);
+    size_t differs = expected.find_first_not_of(c);
+    if (differs != std::string_view::npos) {
+        throw OutputMismatch(pos_ + differs);
+    }
+    if (expected.size() < count) {
+        throw OutputMismatch(pos_ + expected.size());
+    }
+    pos_ += count;
+}
+
+void CompareSink::Finish() const {
+    if (pos_ != expected_.size()) {
+        throw OutputMismatch(pos_);
+    }
+}
+
+void CompareSink::ThrowMismatch(std::string_view text) const {
+    std::string_view rest = expected_.substr(pos_);
+    auto differs =
+        std::mismatch(text.begin(), text.end(), rest.begin(), rest.end()).first;
+    throw OutputMismatch(pos_ + (differs - text.begin()));
+}
@@ -0,0 +1,210 @@
+#include <parser/source.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+#include <system_error>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PARSER_HAS_MMAP 1
+#else
+#include <fstream>
+#endif
+
+namespace {
+
+#if PARSER_HAS_MMAP
+/**
+ * @brief Owns a read-only mapping and unmaps it once the last `Source`
+ * referring to it is gone.
+ */
+struct Mapping {
+    Mapping(void* addr, size_t size) : addr_(addr), size_(size) {
+    }
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+    ~Mapping() {
+        munmap(addr_, size_);
+    }
+
+    void* addr_;
+    size_t size_;
+};
+
+/**
+ * @brief Reads everything from a file descriptor, reserving `size_hint` bytes
+ * upfront.
+ */
+std::string ReadDescriptor(int fd, const std::string& path,
+                           size_t size_hint = 0) {
+    std::string text;
+    text.reserve(size_hint);
+    char buffer[1 << 16];
+    while (true) {
+        ssize_t got = read(fd, buffer, sizeof(buffer));
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), path);
+        }
+        if (got == 0) {
+            return text;
+        }
+        text.append(buffer, static_cast<size_t>(got));
+    }
+}
+#endif
+
+}  // namespace
+
+/**
+ * @brief Offsets of the first character of every line, built on demand.
+ */
+struct Source::LineIndex {
+    std::once_flag built_;
+    std::vector<size_t> starts_;
+};
+
+Source::Source() : lines_(std::make_shared<LineIndex>()) {
+}
+
+Source::Source(std::shared_ptr<const void> storage, std::string_view view)
+    : storage_(std::move(storage)),
+      view_(view),
+      lines_(std::make_shared<LineIndex>()) {
+}
+
+Source Source::FromView(std::string_view text) {
+    return Source(nullptr, text);
+}
+
+Source Source::FromString(std::string text) {
+    auto owned = std::make_shared<const std::string>(std::move(text));
+    std::string_view view = *owned;
+    return Source(std::move(owned), view);
+}
+
+Source Source::FromStream(std::istream& in) {
+    return FromString(std::string(std::istreambuf_iterator<char>(in),
+                                  std::istreambuf_iterator<char>()));
+}
+
+#if PARSER_HAS_MMAP
+Source Source::FromFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        int error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(), path);
+    }
+    if (!S_ISREG(info.st_mode)) {
+        std::string text;
+        try {
+            text = ReadDescriptor(fd, path);
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+        close(fd);
+        return FromString(std::move(text));
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    if (size == 0) {
+        close(fd);
+        return Source();
+    }
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int error = errno;
+    close(fd);
+    if (addr == MAP_FAILED) {
+        throw std::system_error(error, std::generic_category(), path);
+    }
+    madvise(addr, size, MADV_SEQUENTIAL);
+    auto mapping = std::make_shared<const Mapping>(addr, size);
+    return Source(std::move(mapping),
+                  std::string_view(static_cast<const char*>(addr), size));
+}
+
+Source Source::ReadFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+    struct stat info;
+    size_t size_hint = 0;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        size_hint = static_cast<size_t>(info.st_size);
+    }
+    std::string text;
+    try {
+        text = ReadDescriptor(fd, path, size_hint);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+    return FromString(std::move(text));
+}
+#else
+Source Source::FromFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (in.fail()) {
+        throw std::system_error(std::make_error_code(std::errc::io_error),
+                                path);
+    }
+    return FromStream(in);
+}
+
+Source Source::ReadFile(const std::string& path) {
+    return FromFile(path);
+}
+#endif
+
+std::string_view Source::View() const {
+    return view_;
+}
+
+const char* Source::Data() const {
+    return view_.data();
+}
+
+size_t Source::Size() const {
+    return view_.size();
+}
+
+std::pair<size_t, size_t> Source::GetCoords(size_t offset) const {
+    std::call_once(lines_->built_, [this] {
+        std::vector<size_t>& starts = lines_->starts_;
+        starts.push_back(0);
+        const char* begin = view_.data();
+        const char* end = begin + view_.size();
+        for (const char* it = begin; it != end; ++it) {
+            it = static_cast<const char*>(std::memchr(it, '\n', end - it));
+            if (it == nullptr) {
+                break;
+            }
+            starts.push_back(it - begin + 1);
+        }
+    });
+    const std::vector<size_t>& starts = lines_->starts_;
+    // The line containing `offset` is the last one starting at or before it.
+    size_t line = std::upper_bound(starts.begin(), starts.end(), offset) -
+                  starts.begin();
+    return {line, offset - starts[line - 1] + 1};
+}
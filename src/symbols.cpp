@@ -0,0 +1,68 @@
+#include <parser/symbols.h>
+
+#include <cstring>
+
+namespace {
+
+constexpr size_t kInitialSlots = 1024;
+
+}  // namespace
+
+SymbolTable::SymbolTable() : slots_(kInitialSlots, 0) {
+    names_.emplace_back();
+    hashes_.push_back(Hash(std::string_view()));
+    slots_[hashes_[0] & (slots_.size() - 1)] = 1;
+}
+
+Symbol SymbolTable::Intern(std::string_view name) {
+    uint64_t hash = Hash(name);
+    size_t mask = slots_.size() - 1;
+    size_t slot = hash & mask;
+    while (slots_[slot] != 0) {
+        uint32_t id = slots_[slot] - 1;
+        if (hashes_[id] == hash && names_[id] == name) {
+            return Symbol{id};
+        }
+        slot = (slot + 1) & mask;
+    }
+    char* chars = static_cast<char*>(chars_.allocate(name.size(), 1));
+    std::memcpy(chars, name.data(), name.size());
+    uint32_t id = static_cast<uint32_t>(names_.size());
+    names_.emplace_back(chars, name.size());
+    hashes_.push_back(hash);
+    slots_[slot] = id + 1;
+    // Keep the table at most half full so that probe sequences stay short.
+    if (2 * names_.size() > slots_.size()) {
+        Grow();
+    }
+    return Symbol{id};
+}
+
+std::string_view SymbolTable::GetName(Symbol symbol) const {
+    return names_[symbol.id_];
+}
+
+size_t SymbolTable::Size() const {
+    return names_.size();
+}
+
+uint64_t SymbolTable::Hash(std::string_view name) {
+    // FNV-1a; names are short, so a byte-wise hash is good enough.
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : name) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+void SymbolTable::Grow() {
+    slots_.assign(2 * slots_.size(), 0);
+    size_t mask = slots_.size() - 1;
+    for (uint32_t id = 0; id < names_.size(); ++id) {
+        size_t slot = hashes_[id] & mask;
+        while (slots_[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        slots_[slot] = id + 1;
+    }
+}
@@ -1,12 +1,43 @@
 #include <parser/constants.h>
+#include <parser/parallel.h>
+#include <parser/scanner.h>
 #include <parser/tokenizer.h>
 
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <vector>
+
 TokenizerError::TokenizerError(std::pair<size_t, size_t> coords,
                                const std::string &msg)
     : std::runtime_error("[" + std::to_string(coords.first) + ":" +
-                         std::to_string(coords.second - 1) + "] " + msg) {
+                         std::to_string(coords.second - 1) + "] " + msg),
+      coords_(coords),
+      description_(msg) {
+}
+
+std::pair<size_t, size_t> TokenizerError::GetCoords() const {
+    return coords_;
+}
+
+const std::string &TokenizerError::GetDescription() const {
+    return description_;
+}
+
+const char *NeedMoreInput::what() const noexcept {
+    return "More input is needed to read the next token";
+}
+
+namespace {
+
+[[noreturn]] void ThrowMissingLexeme() {
+    throw std::logic_error(
+        "Trying to access a lexeme of a non-identifier-like token. This is "
+        "most likely an error on program's side.");
 }
 
+}  // namespace
+
 Token::Token() : type_(TokenType::EOL) {
 }
 
@@ -22,145 +53,575 @@ TokenType Token::GetType() const {
 }
 
 const std::string &Token::GetLexeme() const {
-    if (lexeme_.has_value()) {
-        return lexeme_.value();
+    if (!lexeme_.has_value()) {
+        ThrowMissingLexeme();
     }
-    throw std::logic_error(
-        "Trying to access a lexeme of a non-identifier-like token. This is "
-        "most likely an error on program's side.");
+    return lexeme_.value();
+}
+
+bool HasLexeme(TokenType type) {
+    switch (type) {
+        case TokenType::IMPORT:
+        case TokenType::AS:
+        case TokenType::MODULE:
+        case TokenType::LET:
+        case TokenType::WHERE:
+        case TokenType::IDENTIFIER:
+        case TokenType::INTEGER:
+        case TokenType::FLOAT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+std::string UnexpectedTokenMessage(TokenType expected, TokenType got) {
+    return "Unexpected token encountered: expected " +
+           std::string(TokenName(expected)) + ", got " +
+           std::string(TokenName(got)) + ".";
+}
+
+size_t TokenBuffer::Size() const {
+    return tokens_.size();
+}
+
+const LexedToken &TokenBuffer::operator[](size_t index) const {
+    return tokens_[index];
+}
+
+std::string_view TokenBuffer::GetLexeme(size_t index) const {
+    const LexedToken &token = tokens_[index];
+    if (!HasLexeme(token.type_)) {
+        ThrowMissingLexeme();
+    }
+    return source_.View().substr(token.offset_, token.length_);
+}
+
+int64_t TokenBuffer::GetInteger(size_t index) const {
+    return static_cast<int64_t>(literal_values_[FindLiteral(index)]);
+}
+
+double TokenBuffer::GetFloat(size_t index) const {
+    double value;
+    std::memcpy(&value, &literal_values_[FindLiteral(index)], sizeof(value));
+    return value;
+}
+
+size_t TokenBuffer::FindLiteral(size_t index) const {
+    return std::lower_bound(literal_tokens_.begin(), literal_tokens_.end(),
+                            index) -
+           literal_tokens_.begin();
+}
+
+size_t TokenBuffer::GetPosition(size_t index) const {
+    return tokens_[index].offset_ + tokens_[index].length_;
+}
+
+std::pair<size_t, size_t> TokenBuffer::GetCoords(size_t index) const {
+    return source_.GetCoords(GetPosition(index));
+}
+
+const std::optional<TokenizerError> &TokenBuffer::GetError() const {
+    return error_;
+}
+
+const Source &TokenBuffer::GetSource() const {
+    return source_;
+}
+
+bool TokenBuffer::operator==(const TokenBuffer &other) const {
+    if (error_.has_value() != other.error_.has_value()) {
+        return false;
+    }
+    if (error_ &&
+        (error_->GetCoords() != other.error_->GetCoords() ||
+         error_->GetDescription() != other.error_->GetDescription())) {
+        return false;
+    }
+    return tokens_ == other.tokens_ &&
+           literal_tokens_ == other.literal_tokens_ &&
+           literal_values_ == other.literal_values_;
+}
+
+bool TokenBuffer::operator!=(const TokenBuffer &other) const {
+    return !(*this == other);
+}
+
+Tokenizer::Tokenizer(Source source, size_t spaces_per_tab)
+    : source_(std::move(source)),
+      pos_(source_.Data()),
+      end_(source_.Data() + source_.Size()),
+      token_begin_(source_.Data()),
+      spaces_per_tab_(spaces_per_tab) {
+}
+
+Tokenizer::Tokenizer(std::string_view text, size_t spaces_per_tab)
+    : Tokenizer(Source::FromView(text), spaces_per_tab) {
 }
 
 Tokenizer::Tokenizer(std::istream *ptr, size_t spaces_per_tab)
-    : in_(ptr), spaces_per_tab_(spaces_per_tab) {
+    : Tokenizer(Source::FromStream(*ptr), spaces_per_tab) {
+}
+
+Tokenizer::Tokenizer(size_t spaces_per_tab)
+    : Tokenizer(Source(), spaces_per_tab) {
+    fed_ = std::make_unique<std::string>();
+    finished_ = false;
+}
+
+void Tokenizer::Feed(std::string_view chunk) {
+    // The fed text may move when it grows, so positions are carried over as
+    // offsets.
+    size_t readable = GetReadableSize();
+    size_t last_eol = chunk.rfind('\n');
+    if (last_eol != std::string_view::npos) {
+        readable = fed_->size() + last_eol + 1;
+    }
+    size_t pos = GetPosition();
+    size_t token_begin = GetTokenOffset();
+    fed_->append(chunk);
+    source_ = Source::FromView(*fed_);
+    pos_ = source_.Data() + pos;
+    token_begin_ = source_.Data() + token_begin;
+    end_ = source_.Data() + readable;
+}
+
+void Tokenizer::Finish() {
+    finished_ = true;
+    end_ = source_.Data() + source_.Size();
+}
+
+size_t Tokenizer::GetReadableSize() const {
+    return end_ - source_.Data();
+}
+
+Tokenizer::Checkpoint Tokenizer::Save() const {
+    Checkpoint checkpoint;
+    checkpoint.pos_ = GetPosition();
+    checkpoint.token_begin_ = GetTokenOffset();
+    checkpoint.current_type_ = current_type_;
+    checkpoint.integer_value_ = integer_value_;
+    checkpoint.float_value_ = float_value_;
+    checkpoint.dedents_ = dedents_;
+    checkpoint.substruct_started_ = substruct_started_;
+    checkpoint.indents_ = indents_;
+    checkpoint.current_indent_spaces_ = current_indent_spaces_;
+    checkpoint.indentation_level_ = indentation_level_;
+    return checkpoint;
+}
+
+void Tokenizer::Restore(const Checkpoint &checkpoint) {
+    pos_ = source_.Data() + checkpoint.pos_;
+    token_begin_ = source_.Data() + checkpoint.token_begin_;
+    current_type_ = checkpoint.current_type_;
+    integer_value_ = checkpoint.integer_value_;
+    float_value_ = checkpoint.float_value_;
+    dedents_ = checkpoint.dedents_;
+    substruct_started_ = checkpoint.substruct_started_;
+    indents_ = checkpoint.indents_;
+    current_indent_spaces_ = checkpoint.current_indent_spaces_;
+    indentation_level_ = checkpoint.indentation_level_;
 }
 
 void Tokenizer::ReadToken(TokenType expected) {
     if (dedents_ > 0) {
         --dedents_;
-        current_token_ = Token(TokenType::DEDENT);
+        SetToken(TokenType::DEDENT, pos_);
         return;
     }
-    while (current_token_.GetType() == TokenType::EOL && in_->peek() == '\n') {
+    if (current_type_ == TokenType::EOL) {
+        if (ReadLineStart()) {
+            return;
+        }
+    } else {
+        pos_ = ScanBlanks(pos_, end_);
+    }
+    ReadLineToken();
+    if (expected != TokenType::NONE && current_type_ != expected) {
+        ThrowError(UnexpectedTokenMessage(expected, current_type_));
+    }
+}
+
+bool Tokenizer::ReadLineStart() {
+    const char *indent_end = ScanBlanks(pos_, end_);
+    if (indent_end == end_ && !finished_) {
+        // Neither the indentation nor the next token is known before the
+        // rest of the line is fed.
+        throw NeedMoreInput();
+    }
+    size_t new_indent = IndentWidth(pos_, indent_end);
+    pos_ = indent_end;
+    if (Peek() == '\n') {
         StreamRead();
-        return;
+        SetToken(TokenType::EOL, pos_);
+        return true;
     }
-    if (current_token_.GetType() == TokenType::EOL) {
-        size_t new_indent = 0;
-        while (std::isspace(in_->peek()) && in_->peek() != '\n') {
-            if (in_->peek() == '\t') {
-                new_indent += spaces_per_tab_;
-            } else {
-                ++new_indent;
-            }
-            StreamRead();
-        }
-        if (in_->peek() == '\n') {
-            StreamRead();
-            return;
+    return ApplyIndent(new_indent);
+}
+
+size_t Tokenizer::IndentWidth(const char *begin, const char *end) const {
+    size_t tabs = std::count(begin, end, '\t');
+    return (end - begin) - tabs + tabs * spaces_per_tab_;
+}
+
+bool Tokenizer::ApplyIndent(size_t new_indent) {
+    if (new_indent > current_indent_spaces_) {
+        if (new_indent >= 2 && new_indent - 2 >= current_indent_spaces_ &&
+            substruct_started_) {
+            indents_.push(new_indent - current_indent_spaces_);
+            current_indent_spaces_ = new_indent;
+            ++indentation_level_;
+            SetToken(TokenType::INDENT, pos_);
+            return true;
+        } else {
+            ThrowError(
+                "Encountered an indent greater than the "
+                "indent of the block.");
         }
-        if (new_indent > current_indent_spaces_) {
-            if (new_indent >= 2 && new_indent - 2 >= current_indent_spaces_ &&
-                substruct_started_) {
-                indents_.push(new_indent - current_indent_spaces_);
-                current_indent_spaces_ = new_indent;
-                ++indentation_level_;
-                current_token_ = Token(TokenType::INDENT);
-                return;
-            } else {
-                ThrowError(
-                    "Encountered an indent greater than the "
-                    "indent of the block.");
+    } else if (new_indent < current_indent_spaces_) {
+        if (indentation_level_ != 0) {
+            size_t space_diff = current_indent_spaces_ - new_indent;
+            while (new_indent < current_indent_spaces_) {
+                current_indent_spaces_ -= indents_.top();
+                indents_.pop();
+                ++dedents_;
             }
-        } else if (new_indent < current_indent_spaces_) {
-            if (indentation_level_ != 0) {
-                size_t space_diff = current_indent_spaces_ - new_indent;
-                while (new_indent < current_indent_spaces_) {
-                    current_indent_spaces_ -= indents_.top();
-                    indents_.pop();
-                    ++dedents_;
-                }
-                if (new_indent != current_indent_spaces_) {
-                    ThrowError("Unexpected indentation encountered.");
-                }
-                --dedents_;
-                --indentation_level_;
-                current_token_ = Token(TokenType::DEDENT);
-                return;
-            } else {
-                ThrowError(
-                    "Encountered more dedents than there were indents prior.");
+            if (new_indent != current_indent_spaces_) {
+                ThrowError("Unexpected indentation encountered.");
             }
-        }
-        substruct_started_ = false;
-    } else {
-        while (std::isspace(in_->peek()) && in_->peek() != '\n') {
-            StreamRead();
+            --dedents_;
+            --indentation_level_;
+            SetToken(TokenType::DEDENT, pos_);
+            return true;
+        } else {
+            ThrowError(
+                "Encountered more dedents than there were indents prior.");
         }
     }
-    std::string token_string;
-    char next = in_->peek();
-    if (std::isdigit(next)) {
+    substruct_started_ = false;
+    return false;
+}
+
+void Tokenizer::ReadLineToken() {
+    const char *begin = pos_;
+    int next = Peek();
+    uint8_t next_class = CharClassOf(next);
+    if (next_class & kCharDigit) {
         ReadNumber();
-    } else if (std::isalpha(next) || next == '_') {
+    } else if (next_class & (kCharAlpha | kCharUnderscore)) {
         ReadWord();
     } else if (next == '.') {
         StreamRead();
-        current_token_ = Token(TokenType::DOT);
+        SetToken(TokenType::DOT, begin);
     } else if (next == ',') {
         StreamRead();
-        current_token_ = Token(TokenType::COMMA);
+        SetToken(TokenType::COMMA, begin);
     } else if (next == ':') {
         StreamRead();
+        // The error is reported after the character following `:`, even if
+        // there is none.
+        size_t after = GetPosition() + 1;
         if (StreamRead() == '=') {
-            current_token_ = Token(TokenType::ASSIGN);
+            SetToken(TokenType::ASSIGN, begin);
         } else {
             ThrowError(
                 "Unknown symbol encountered while tokenizing. "
-                "Maybe you meant `:=`?");
+                "Maybe you meant `:=`?",
+                after);
         }
     } else if (next == '\n') {
         StreamRead();
-        current_token_ = Token(TokenType::EOL);
+        SetToken(TokenType::EOL, begin);
     } else if (next == '(') {
         StreamRead();
-        current_token_ = Token(TokenType::L_BRACKET);
+        SetToken(TokenType::L_BRACKET, begin);
     } else if (next == ')') {
         StreamRead();
-        current_token_ = Token(TokenType::R_BRACKET);
+        SetToken(TokenType::R_BRACKET, begin);
     } else if (next == '+') {
         StreamRead();
-        current_token_ = Token(TokenType::ADD);
+        SetToken(TokenType::ADD, begin);
     } else if (next == '-') {
         StreamRead();
-        current_token_ = Token(TokenType::SUB);
+        SetToken(TokenType::SUB, begin);
     } else if (next == '/') {
         StreamRead();
-        current_token_ = Token(TokenType::DIV);
+        SetToken(TokenType::DIV, begin);
     } else if (next == '*') {
         StreamRead();
-        current_token_ = Token(TokenType::MUL);
+        SetToken(TokenType::MUL, begin);
     } else if (next == '^') {
         StreamRead();
-        current_token_ = Token(TokenType::POW);
+        SetToken(TokenType::POW, begin);
     } else if (next == -1) {
-        current_token_ = Token(TokenType::FILE_END);
+        SetToken(TokenType::FILE_END, begin);
     } else {
         ThrowError("Unknown symbol encountered while tokenizing: `" +
                    std::string(1, static_cast<char>(next)) + "`.");
     }
-    if (expected != TokenType::NONE && current_token_.GetType() != expected) {
-        ThrowError("Unexpected token encountered: expected " +
-                   kTokenName.at(expected) + ", got " +
-                   kTokenName.at(current_token_.GetType()) + ".");
-    }
 }
 
 Token Tokenizer::GetToken() const {
-    return current_token_;
+    if (HasLexeme(current_type_)) {
+        return Token(current_type_, std::string(GetTokenLexeme()));
+    }
+    return Token(current_type_);
+}
+
+TokenType Tokenizer::GetTokenType() const {
+    return current_type_;
+}
+
+std::string_view Tokenizer::GetTokenLexeme() const {
+    if (!HasLexeme(current_type_)) {
+        ThrowMissingLexeme();
+    }
+    return std::string_view(token_begin_, pos_ - token_begin_);
+}
+
+size_t Tokenizer::GetTokenOffset() const {
+    return token_begin_ - source_.Data();
+}
+
+int64_t Tokenizer::GetTokenInteger() const {
+    return integer_value_;
+}
+
+double Tokenizer::GetTokenFloat() const {
+    return float_value_;
+}
+
+TokenBuffer Tokenizer::Tokenize(size_t threads, size_t min_chunk_size) {
+    if (source_.Size() > TokenBuffer::kMaxSourceSize) {
+        throw std::length_error(
+            "Source is too large to be tokenized into a token buffer.");
+    }
+    threads = std::min(threads,
+                       source_.Size() / std::max<size_t>(min_chunk_size, 1));
+    if (threads > 1 && GetPosition() == 0 &&
+        current_type_ == TokenType::EOL && finished_) {
+        return TokenizeParallel(threads);
+    }
+    TokenBuffer buffer;
+    buffer.source_ = source_;
+    buffer.tokens_.reserve(source_.Size() / 4 + 1);
+    try {
+        do {
+            ReadToken();
+            AppendToken(buffer);
+        } while (current_type_ != TokenType::FILE_END);
+    } catch (const TokenizerError &e) {
+        buffer.error_ = e;
+    }
+    return buffer;
+}
+
+/**
+ * @struct Tokenizer::LexedLine
+ * @brief A line lexed on its own. Its tokens start after the indentation and
+ * end with its end of line (or the end of the file), unless lexing them
+ * failed.
+ */
+struct Tokenizer::LexedLine {
+    uint32_t indent_end_;  // offset right after the indentation
+    size_t indent_width_;
+    uint32_t first_token_;  // range of its tokens in the chunk
+    uint32_t end_token_;
+    bool blank_;  // nothing but blanks up to the end of line
+    bool where_;  // contains `where`
+
+    // Set by the sequential pass: the indent or the dedents preceding it.
+    TokenType indent_type_ = TokenType::NONE;
+    uint32_t indent_tokens_ = 0;
+};
+
+/**
+ * @struct Tokenizer::LexedChunk
+ * @brief Lines `[begin_, end_)` of the source lexed by one thread.
+ */
+struct Tokenizer::LexedChunk {
+    const char *begin_;
+    const char *end_;
+    std::vector<LexedLine> lines_;
+    TokenBuffer tokens_;  // tokens of the lines, the error ending the last one
+
+    // Set by the sequential pass: how many lines make it to the result and
+    // where their tokens and literals go.
+    size_t kept_lines_ = 0;
+    size_t first_output_ = 0;
+    size_t first_literal_ = 0;
+};
+
+void Tokenizer::LexLines(LexedChunk &chunk) {
+    // Chunks but the last one end right after an end of line, the last one
+    // with the line holding the end of the file.
+    bool last = chunk.end_ == source_.Data() + source_.Size();
+    pos_ = chunk.begin_;
+    end_ = chunk.end_;
+    chunk.tokens_.tokens_.reserve((end_ - pos_) / 4 + 1);
+    while (last || pos_ != end_) {
+        LexedLine line;
+        const char *indent_end = ScanBlanks(pos_, end_);
+        line.indent_end_ = static_cast<uint32_t>(indent_end - source_.Data());
+        line.indent_width_ = IndentWidth(pos_, indent_end);
+        line.first_token_ =
+            static_cast<uint32_t>(chunk.tokens_.tokens_.size());
+        pos_ = indent_end;
+        line.blank_ = Peek() == '\n';
+        substruct_started_ = false;
+        try {
+            if (line.blank_) {
+                StreamRead();
+                SetToken(TokenType::EOL, pos_);
+                AppendToken(chunk.tokens_);
+            } else {
+                do {
+                    pos_ = ScanBlanks(pos_, end_);
+                    ReadLineToken();
+                    AppendToken(chunk.tokens_);
+                } while (current_type_ != TokenType::EOL &&
+                         current_type_ != TokenType::FILE_END);
+            }
+        } catch (const TokenizerError &e) {
+            chunk.tokens_.error_ = e;
+        }
+        line.where_ = substruct_started_;
+        line.end_token_ = static_cast<uint32_t>(chunk.tokens_.tokens_.size());
+        chunk.lines_.push_back(line);
+        if (chunk.tokens_.error_ || current_type_ == TokenType::FILE_END) {
+            return;
+        }
+    }
+}
+
+TokenBuffer Tokenizer::TokenizeParallel(size_t threads) {
+    const char *data = source_.Data();
+    const char *end = data + source_.Size();
+    std::vector<LexedChunk> chunks;
+    const char *begin = data;
+    for (size_t i = 1; i <= threads && begin != end; ++i) {
+        const char *split = end;
+        if (i < threads) {
+            split = std::max(begin, data + source_.Size() / threads * i);
+            split = static_cast<const char *>(
+                std::memchr(split, '\n', end - split));
+            split = split != nullptr ? split + 1 : end;
+        }
+        chunks.push_back({begin, split, {}, {}});
+        begin = split;
+    }
+    ParallelFor(chunks.size(), threads, [this, &chunks](size_t i) {
+        Tokenizer(source_, spaces_per_tab_).LexLines(chunks[i]);
+    });
+
+    // Indentation is applied line by line in order, the way `ReadToken`
+    // would, and counts the tokens it adds.
+    TokenBuffer buffer;
+    buffer.source_ = source_;
+    size_t tokens = 0;
+    size_t literals = 0;
+    for (LexedChunk &chunk : chunks) {
+        chunk.first_output_ = tokens;
+        chunk.first_literal_ = literals;
+        for (LexedLine &line : chunk.lines_) {
+            if (!line.blank_) {
+                pos_ = data + line.indent_end_;
+                try {
+                    if (ApplyIndent(line.indent_width_)) {
+                        line.indent_type_ = current_type_;
+                        line.indent_tokens_ = 1 + dedents_;
+                        dedents_ = 0;
+                    }
+                } catch (const TokenizerError &e) {
+                    buffer.error_ = e;
+                    break;
+                }
+                if (line.where_) {
+                    substruct_started_ = true;
+                }
+            }
+            ++chunk.kept_lines_;
+            tokens += line.indent_tokens_ + line.end_token_ - line.first_token_;
+        }
+        if (chunk.kept_lines_ > 0) {
+            const std::vector<uint32_t> &chunk_literals =
+                chunk.tokens_.literal_tokens_;
+            literals += std::lower_bound(
+                            chunk_literals.begin(), chunk_literals.end(),
+                            chunk.lines_[chunk.kept_lines_ - 1].end_token_) -
+                        chunk_literals.begin();
+        }
+        if (!buffer.error_ && chunk.kept_lines_ == chunk.lines_.size()) {
+            buffer.error_ = chunk.tokens_.error_;
+        }
+        if (buffer.error_) {
+            break;
+        }
+    }
+
+    buffer.tokens_.resize(tokens);
+    buffer.literal_tokens_.resize(literals);
+    buffer.literal_values_.resize(literals);
+    ParallelFor(chunks.size(), threads, [&buffer, &chunks](size_t i) {
+        const LexedChunk &chunk = chunks[i];
+        const TokenBuffer &lexed = chunk.tokens_;
+        size_t output = chunk.first_output_;
+        size_t literal = 0;
+        for (size_t j = 0; j < chunk.kept_lines_; ++j) {
+            const LexedLine &line = chunk.lines_[j];
+            for (uint32_t k = 0; k < line.indent_tokens_; ++k) {
+                buffer.tokens_[output++] =
+                    LexedToken{line.indent_type_, line.indent_end_, 0};
+            }
+            for (uint32_t k = line.first_token_; k < line.end_token_; ++k) {
+                if (literal < lexed.literal_tokens_.size() &&
+                    lexed.literal_tokens_[literal] == k) {
+                    size_t index = chunk.first_literal_ + literal;
+                    buffer.literal_tokens_[index] =
+                        static_cast<uint32_t>(output);
+                    buffer.literal_values_[index] =
+                        lexed.literal_values_[literal];
+                    ++literal;
+                }
+                buffer.tokens_[output++] = lexed.tokens_[k];
+            }
+        }
+    });
+
+    if (!buffer.tokens_.empty()) {
+        const LexedToken &token = buffer.tokens_.back();
+        SetToken(token.type_, data + token.offset_);
+        pos_ = data + token.offset_ + token.length_;
+    }
+    return buffer;
+}
+
+void Tokenizer::AppendToken(TokenBuffer &buffer) const {
+    if (current_type_ == TokenType::INTEGER ||
+        current_type_ == TokenType::FLOAT) {
+        uint64_t bits = static_cast<uint64_t>(integer_value_);
+        if (current_type_ == TokenType::FLOAT) {
+            std::memcpy(&bits, &float_value_, sizeof(bits));
+        }
+        buffer.literal_tokens_.push_back(
+            static_cast<uint32_t>(buffer.tokens_.size()));
+        buffer.literal_values_.push_back(bits);
+    }
+    buffer.tokens_.push_back(LexedToken{
+        current_type_, static_cast<uint32_t>(GetTokenOffset()),
+        static_cast<uint32_t>(pos_ - token_begin_)});
 }
 
 std::pair<size_t, size_t> Tokenizer::GetCoords() const {
-    return {line_, column_};
+    return source_.GetCoords(GetPosition());
+}
+
+size_t Tokenizer::GetPosition() const {
+    return pos_ - source_.Data();
+}
+
+const Source &Tokenizer::GetSource() const {
+    return source_;
 }
 
 bool Token::operator==(const Token &other) const {
@@ -171,55 +632,57 @@ bool Token::operator!=(const Token &other) const {
     return !(*this == other);
 }
 
+void Tokenizer::SetToken(TokenType type, const char *begin) {
+    current_type_ = type;
+    token_begin_ = begin;
+}
+
 void Tokenizer::ThrowError(std::string msg) {
-    throw TokenizerError(GetCoords(), msg);
+    ThrowError(std::move(msg), GetPosition());
+}
+
+void Tokenizer::ThrowError(std::string msg, size_t offset) {
+    throw TokenizerError(source_.GetCoords(offset), msg);
+}
+
+int Tokenizer::Peek() const {
+    return pos_ != end_ ? static_cast<unsigned char>(*pos_) : -1;
 }
 
 char Tokenizer::StreamRead() {
-    char result = in_->get();
-    if (result == '\n') {
-        ++line_;
-        column_ = 1;
-    } else {
-        ++column_;
-    }
-    return result;
+    return pos_ != end_ ? *pos_++ : -1;
 }
 
 void Tokenizer::ReadNumber() {
-    std::string token_string;
-    while (std::isdigit(in_->peek())) {
-        token_string += StreamRead();
-    }
+    const char *begin = pos_;
+    pos_ = ScanDigits(pos_, end_);
     bool is_float = false;
-    if (in_->peek() == '.') {
+    if (Peek() == '.') {
         is_float = true;
-        token_string += StreamRead();
-        while (std::isdigit(in_->peek())) {
-            token_string += StreamRead();
-        }
+        StreamRead();
+        pos_ = ScanDigits(pos_, end_);
     }
-    if (std::isalpha(in_->peek())) {
+    if (CharClassOf(Peek()) & kCharAlpha) {
         ThrowError(
             "Encountered a token starting with a number that "
             "is not a number itself: `" +
-            token_string + "` and on.");
+            std::string(begin, pos_) + "` and on.");
+    }
+    std::from_chars_result result =
+        is_float ? std::from_chars(begin, pos_, float_value_)
+                 : std::from_chars(begin, pos_, integer_value_);
+    if (result.ec != std::errc() || result.ptr != pos_) {
+        ThrowError("Number literal is out of range: `" +
+                   std::string(begin, pos_) + "`.");
     }
-    current_token_ = is_float ? Token(TokenType::FLOAT, token_string)
-                              : Token(TokenType::INTEGER, token_string);
+    SetToken(is_float ? TokenType::FLOAT : TokenType::INTEGER, begin);
 }
 
 void Tokenizer::ReadWord() {
-    std::string token_string;
-    while (std::isalnum(in_->peek()) || in_->peek() == '_') {
-        token_string += StreamRead();
-    }
-    if (kStringToToken.count(token_string) != 0) {
-        current_token_ = kStringToToken.at(token_string);
-    } else {
-        current_token_ = Token(TokenType::IDENTIFIER, token_string);
-    }
-    if (current_token_.GetType() == TokenType::WHERE) {
+    const char *begin = pos_;
+    pos_ = ScanWord(pos_, end_);
+    SetToken(LookupKeyword(std::string_view(begin, pos_ - begin)), begin);
+    if (current_type_ == TokenType::WHERE) {
         substruct_started_ = true;
     }
 }
@@ -0,0 +1,148 @@
+// Applies random edits to random sources through `IncrementalParser` and
+// checks that after every `Parse` the module, or the error, is the one
+// `Parser::ParseFile` gives for the whole text.
+//
+// Usage: incremental_test [seed] [sources]
+
+#include "testing.h"
+
+#include <parser/incremental.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr size_t kEditsPerSource = 60;
+constexpr size_t kSpacesPerTab = 4;
+
+/**
+ * @brief Gets the offsets top-level items may start at: starts of lines that
+ * are not indented, and the end of the text if it ends a line.
+ */
+std::vector<size_t> GetItemStarts(const std::string& text) {
+    std::vector<size_t> starts;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if ((i == 0 || text[i - 1] == '\n') && text[i] != ' ' &&
+            text[i] != '\n') {
+            starts.push_back(i);
+        }
+    }
+    if (text.empty() || text.back() == '\n') {
+        starts.push_back(text.size());
+    }
+    return starts;
+}
+
+bool IsWordChar(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.';
+}
+
+/**
+ * @brief Generates an edit of `text`. Most of them keep a valid text valid:
+ * inserting or deleting a top-level item or renaming a name or a number. The
+ * others replace a random range with a stray character, a piece of another
+ * source or nothing.
+ */
+TextEdit GenerateEdit(std::mt19937& rng, const std::string& text) {
+    std::vector<size_t> starts = GetItemStarts(text);
+    size_t kind = GetRandom(rng, 0, 9);
+    if (kind < 3 && !starts.empty()) {
+        TextEdit edit{starts[GetRandom(rng, 0, starts.size() - 1)], 0, ""};
+        GenerateDeclaration(rng, 0, 0, edit.text_);
+        return edit;
+    }
+    if (kind < 4 && starts.size() > 1) {
+        size_t item = GetRandom(rng, 0, starts.size() - 2);
+        return {starts[item], starts[item + 1] - starts[item], ""};
+    }
+    if (kind < 7 && !text.empty()) {
+        size_t begin = GetRandom(rng, 0, text.size() - 1);
+        if (IsWordChar(text[begin])) {
+            size_t end = begin;
+            while (begin > 0 && IsWordChar(text[begin - 1])) {
+                --begin;
+            }
+            while (end < text.size() && IsWordChar(text[end])) {
+                ++end;
+            }
+            std::string word = GetChance(rng, 0.7)
+                                   ? GenerateName(rng)
+                                   : std::to_string(GetRandom(rng, 0, 999));
+            return {begin, end - begin, word};
+        }
+    }
+    size_t offset = GetRandom(rng, 0, text.size());
+    TextEdit edit{offset,
+                  GetRandom(rng, 0, std::min<size_t>(text.size() - offset, 40)),
+                  ""};
+    if (GetChance(rng, 0.4)) {
+        edit.text_ += kNoise[GetRandom(rng, 0, sizeof(kNoise) - 2)];
+    } else if (GetChance(rng, 0.5)) {
+        std::string donor = GenerateSource(rng, 3);
+        size_t begin = GetRandom(rng, 0, donor.size());
+        edit.text_ = donor.substr(begin, GetRandom(rng, 0, 60));
+    }
+    return edit;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    unsigned seed = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 42;
+    size_t sources = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 500;
+    std::mt19937 rng(seed);
+
+    size_t parses = 0;
+    size_t valid = 0;
+    size_t failures = 0;
+    for (size_t i = 0; i < sources; ++i) {
+        std::string text = GenerateSource(rng);
+        IncrementalParser parser(text, kSpacesPerTab);
+        // Edits since the text was last valid, undone in reverse most times
+        // they break it, so that most parses are of valid texts.
+        std::vector<TextEdit> undo;
+        for (size_t step = 0; step < kEditsPerSource; ++step) {
+            TextEdit edit = GenerateEdit(rng, text);
+            undo.push_back({edit.offset_, edit.text_.size(),
+                            text.substr(edit.offset_, edit.length_)});
+            parser.Edit(edit.offset_, edit.length_, edit.text_);
+            text.replace(edit.offset_, edit.length_, edit.text_);
+            // Some edits are parsed together with the next ones.
+            if (step + 1 < kEditsPerSource && GetChance(rng, 0.3)) {
+                continue;
+            }
+
+            ++parses;
+            std::string expected = DescribeParseFile(text, kSpacesPerTab);
+            std::string got = Describe(
+                [&]() -> const Module& { return parser.Parse(); });
+            if (parser.GetText() != text || got != expected) {
+                if (++failures <= 3) {
+                    std::printf(
+                        "Mismatch in source %zu after edit %zu.\n"
+                        "--- text\n%s\n--- expected\n%s\n--- got\n%s\n",
+                        i, step, text.c_str(), expected.c_str(), got.c_str());
+                }
+            }
+            if (expected.starts_with("module:")) {
+                ++valid;
+                undo.clear();
+            } else if (GetChance(rng, 0.8)) {
+                for (auto it = undo.rbegin(); it != undo.rend(); ++it) {
+                    parser.Edit(it->offset_, it->length_, it->text_);
+                    text.replace(it->offset_, it->length_, it->text_);
+                }
+                undo.clear();
+            }
+        }
+    }
+    std::printf(
+        "%zu of %zu parses (%zu valid) differ from parsing the whole text.\n",
+        failures, parses, valid);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
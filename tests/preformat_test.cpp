@@ -0,0 +1,89 @@
+// Parses and generates random sources with `PreformatFile` in batches small
+// enough for every source to be split, and checks that putting them together
+// gives the output, or the error, `Parser::ParseFile` gives.
+//
+// Usage: preformat_test [seed] [sources]
+
+#include "testing.h"
+
+#include <parser/formatter.h>
+#include <parser/source.h>
+#include <parser/tokenizer.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+constexpr size_t kSpacesPerTab = 4;
+
+/**
+ * @brief Appends `where` to a random top-level line of `text` that declares
+ * a constant. The parser then takes the lines after it, though not
+ * indented, for its body, so that batches starting at them are not used.
+ */
+void OpenUnindentedBody(std::mt19937& rng, std::string& text) {
+    std::vector<size_t> ends;
+    for (size_t begin = 0; begin < text.size();) {
+        size_t end = std::min(text.find('\n', begin), text.size());
+        std::string_view line(text.data() + begin, end - begin);
+        if (line.starts_with("let ") &&
+            line.find('(') > line.find(":=") &&
+            line.find(" where") == std::string_view::npos) {
+            ends.push_back(end);
+        }
+        begin = end + 1;
+    }
+    if (!ends.empty()) {
+        text.insert(ends[GetRandom(rng, 0, ends.size() - 1)], " where");
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    unsigned seed = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 42;
+    size_t sources = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000;
+    std::mt19937 rng(seed);
+
+    const size_t kThreads[] = {1, 2, 4};
+    const size_t kMinBatchSizes[] = {1, 8, 64};
+    size_t runs = 0;
+    size_t valid = 0;
+    size_t failures = 0;
+    for (size_t i = 0; i < sources; ++i) {
+        std::string text = GenerateSource(rng, 20);
+        if (GetChance(rng, 0.3)) {
+            OpenUnindentedBody(rng, text);
+        }
+        std::string expected = DescribeParseFile(text, kSpacesPerTab);
+        valid += expected.starts_with("module:");
+        Source source = Source::FromString(text);
+        TokenBuffer tokens = Tokenizer(source, kSpacesPerTab).Tokenize();
+        for (size_t threads : kThreads) {
+            for (size_t min_batch_tokens : kMinBatchSizes) {
+                ++runs;
+                std::string got = Describe([&] {
+                    return PreformatFile(tokens, threads, min_batch_tokens);
+                });
+                if (got != expected && ++failures <= 3) {
+                    std::printf(
+                        "Mismatch in source %zu on %zu threads in batches of "
+                        "at least %zu tokens.\n--- text\n%s\n--- expected\n"
+                        "%s\n--- got\n%s\n",
+                        i, threads, min_batch_tokens, text.c_str(),
+                        expected.c_str(), got.c_str());
+                }
+            }
+        }
+    }
+    std::printf(
+        "%zu of %zu runs over %zu sources (%zu valid) differ from parsing the "
+        "whole source.\n",
+        failures, runs, sources, valid);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
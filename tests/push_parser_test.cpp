@@ -0,0 +1,105 @@
+// Feeds random sources to `PushParser` in chunks of random sizes, one byte
+// at a time included, and checks that the module, or the error, is the one
+// `Parser::ParseFile` gives for the whole source.
+//
+// Usage: push_parser_test [seed] [sources]
+
+#include "testing.h"
+
+#include <parser/push_parser.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <variant>
+
+namespace {
+
+constexpr size_t kSpacesPerTab = 4;
+
+/**
+ * @brief Checks whether every expression of `module` and its submodules is
+ * stored in its `FlatAst`.
+ */
+bool IsFlat(const Module& module) {
+    for (const Declaration& decl : module.declarations_) {
+        if (const Module* submodule = std::get_if<Module>(&decl)) {
+            if (!IsFlat(*submodule)) {
+                return false;
+            }
+        } else if (const Function* function = std::get_if<Function>(&decl)) {
+            if (!std::holds_alternative<FlatExpression>(function->value_) ||
+                (function->body_ && !IsFlat(*function->body_))) {
+                return false;
+            }
+        } else if (!std::holds_alternative<FlatExpression>(
+                       std::get<Constant>(decl).value_)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Feeds `text` to a push parser in chunks of `1` to `max_chunk`
+ * bytes, with an empty chunk now and then.
+ */
+Module FeedInChunks(std::mt19937& rng, std::string_view text,
+                    size_t max_chunk, Allocation allocation) {
+    PushParser parser(kSpacesPerTab, allocation);
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t size = GetChance(rng, 0.05) ? 0 : GetRandom(rng, 1, max_chunk);
+        size = std::min(size, text.size() - pos);
+        parser.Feed(text.substr(pos, size));
+        pos += size;
+    }
+    Module module = parser.Finish();
+    if (allocation == Allocation::FLAT && !IsFlat(module)) {
+        throw std::logic_error("Expressions are not stored flat.");
+    }
+    return module;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    unsigned seed = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 42;
+    size_t sources = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000;
+    std::mt19937 rng(seed);
+
+    const size_t kMaxChunks[] = {1, 7, 64, 4096};
+    const Allocation kAllocations[] = {Allocation::HEAP, Allocation::ARENA,
+                                       Allocation::FLAT};
+    size_t feeds = 0;
+    size_t valid = 0;
+    size_t failures = 0;
+    for (size_t i = 0; i < sources; ++i) {
+        std::string text = GenerateSource(rng, GetChance(rng, 0.1) ? 40 : 8);
+        std::string expected = DescribeParseFile(text, kSpacesPerTab);
+        valid += expected.starts_with("module:");
+        for (size_t max_chunk : kMaxChunks) {
+            for (Allocation allocation : kAllocations) {
+                ++feeds;
+                std::string got = Describe([&] {
+                    return FeedInChunks(rng, text, max_chunk, allocation);
+                });
+                if (got != expected && ++failures <= 3) {
+                    std::printf(
+                        "Mismatch in source %zu fed in chunks of up to %zu "
+                        "bytes.\n--- text\n%s\n--- expected\n%s\n--- got\n%s\n",
+                        i, max_chunk, text.c_str(), expected.c_str(),
+                        got.c_str());
+                }
+            }
+        }
+    }
+    std::printf(
+        "%zu of %zu feeds of %zu sources (%zu valid) differ from parsing the "
+        "whole source.\n",
+        failures, feeds, sources, valid);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
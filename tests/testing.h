@@ -0,0 +1,221 @@
+#pragma once
+
+#include <parser/formatter.h>
+#include <parser/parser.h>
+#include <parser/sink.h>
+#include <parser/tokenizer.h>
+
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <random>
+#include <string>
+#include <string_view>
+
+// Helpers shared by the tests: a generator of random sources, mostly valid
+// ones with a few bytes garbled now and then, and a way to compare what two
+// parsers make of the same text.
+
+inline const char* const kNames[] = {"a", "b", "foo", "bar_1", "x",
+                                     "y", "z", "_q",  "f",     "Long_name2",
+                                     "g"};
+inline const char kNoise[] = " \t\n()+-*/^:=,.ab1$";
+
+inline size_t GetRandom(std::mt19937& rng, size_t from, size_t to) {
+    return std::uniform_int_distribution<size_t>(from, to)(rng);
+}
+
+inline bool GetChance(std::mt19937& rng, double probability) {
+    return std::bernoulli_distribution(probability)(rng);
+}
+
+inline std::string GenerateName(std::mt19937& rng) {
+    return kNames[GetRandom(rng, 0, std::size(kNames) - 1)];
+}
+
+inline std::string GenerateExpression(std::mt19937& rng, size_t depth = 0);
+
+inline std::string GenerateOperand(std::mt19937& rng, size_t depth) {
+    size_t kind = depth > 4 ? 0 : GetRandom(rng, 0, 9);
+    switch (kind) {
+        case 0:
+        case 1:
+        case 2:
+            return GenerateName(rng);
+        case 3:
+            return std::to_string(GetRandom(rng, 0, 100000));
+        case 4: {
+            std::string number = std::to_string(GetRandom(rng, 0, 999));
+            number += '.';
+            number += std::to_string(GetRandom(rng, 0, 9999));
+            return number;
+        }
+        case 5:
+        case 6: {
+            std::string operand = "(";
+            operand += GenerateExpression(rng, depth + 1);
+            operand += ')';
+            return operand;
+        }
+        case 7:
+        case 8: {
+            std::string call = GenerateName(rng);
+            call += '(';
+            for (size_t i = GetRandom(rng, 0, 3); i > 0; --i) {
+                call += GenerateExpression(rng, depth + 1);
+                call += i > 1 ? ", " : "";
+            }
+            call += ')';
+            return call;
+        }
+        default: {
+            std::string operand = "-";
+            operand += GenerateOperand(rng, depth + 1);
+            return operand;
+        }
+    }
+}
+
+inline std::string GenerateExpression(std::mt19937& rng, size_t depth) {
+    static const char kOperators[] = "+-*/^";
+    std::string expression = GenerateOperand(rng, depth);
+    for (size_t i = GetRandom(rng, 0, 3); i > 0; --i) {
+        char op = kOperators[GetRandom(rng, 0, 4)];
+        expression += GetChance(rng, 0.5) ? " " : "";
+        expression += op;
+        expression += GetChance(rng, 0.5) ? " " : "";
+        expression += op == '^' ? GenerateName(rng)
+                                : GenerateOperand(rng, depth + 1);
+    }
+    return expression;
+}
+
+inline void GenerateDeclaration(std::mt19937& rng, size_t indent,
+                                size_t depth, std::string& out) {
+    std::string pad(indent, ' ');
+    size_t kind = GetRandom(rng, 0, 19);
+    if (kind < 3) {
+        // Every module has one alias only, or importing it again is an
+        // error.
+        std::string name = GenerateName(rng);
+        if (GetChance(rng, 0.3)) {
+            out += pad + "import lib" + name + " as " + name;
+        } else {
+            out += pad + "import " + name;
+        }
+        if (GetChance(rng, 0.5)) {
+            out += " (";
+            for (size_t i = GetRandom(rng, 1, 3); i > 0; --i) {
+                out += GenerateName(rng);
+                out += i > 1 ? ", " : "";
+            }
+            out += ')';
+        }
+        out += '\n';
+    } else if (kind < 6 && depth < 3) {
+        out += pad + "module " + GenerateName(rng) + " where\n";
+        for (size_t i = GetRandom(rng, 1, 3); i > 0; --i) {
+            GenerateDeclaration(rng, indent + 2, depth + 1, out);
+        }
+    } else if (kind < 10 && depth < 3) {
+        out += pad + "let " + GenerateName(rng) + "(";
+        for (size_t i = GetRandom(rng, 1, 3); i > 0; --i) {
+            out += GenerateName(rng);
+            out += i > 1 ? ", " : "";
+        }
+        out += ") := " + GenerateExpression(rng) + " where\n";
+        for (size_t i = GetRandom(rng, 1, 3); i > 0; --i) {
+            GenerateDeclaration(rng, indent + 2, depth + 1, out);
+        }
+    } else {
+        out += pad + "let " + GenerateName(rng) + " := " +
+               GenerateExpression(rng) + "\n";
+    }
+    if (GetChance(rng, 0.1)) {
+        out += '\n';
+    }
+    if (GetChance(rng, 0.05)) {
+        out += "   \n";
+    }
+}
+
+/**
+ * @brief Generates a valid source of up to `items` top-level items.
+ */
+inline std::string GenerateValidSource(std::mt19937& rng, size_t items = 8) {
+    std::string source;
+    for (size_t i = GetRandom(rng, 1, items); i > 0; --i) {
+        GenerateDeclaration(rng, 0, 0, source);
+    }
+    return source;
+}
+
+/**
+ * @brief Deletes, inserts or replaces a few random bytes of `source`.
+ */
+inline void Garble(std::mt19937& rng, std::string& source) {
+    for (size_t i = GetRandom(rng, 1, 3); i > 0 && !source.empty(); --i) {
+        size_t pos = GetRandom(rng, 0, source.size() - 1);
+        char noise = kNoise[GetRandom(rng, 0, sizeof(kNoise) - 2)];
+        switch (GetRandom(rng, 0, 2)) {
+            case 0:
+                source.erase(pos, 1);
+                break;
+            case 1:
+                source.insert(pos, 1, noise);
+                break;
+            default:
+                source[pos] = noise;
+        }
+    }
+}
+
+/**
+ * @brief Generates a source of up to `items` top-level items. About a third
+ * of the sources are garbled or miss the last line break, which makes most of
+ * them invalid.
+ */
+inline std::string GenerateSource(std::mt19937& rng, size_t items = 8) {
+    std::string source = GenerateValidSource(rng, items);
+    if (GetChance(rng, 0.25)) {
+        Garble(rng, source);
+    } else if (GetChance(rng, 0.1)) {
+        source.pop_back();
+    }
+    return source;
+}
+
+/**
+ * @brief Runs `parse` and formats the module it returns, or describes the
+ * error it throws, so that the results of two parsers can be compared as
+ * strings.
+ */
+template <class Parse>
+std::string Describe(Parse&& parse) {
+    try {
+        StringSink sink;
+        CodeGenerator generator(sink);
+        generator.Generate(parse());
+        std::string description = "module:\n";
+        description += sink.View();
+        return description;
+    } catch (const TokenizerError& e) {
+        return std::string("tokenizer error: ") + e.what();
+    } catch (const ParserError& e) {
+        return std::string("parser error: ") + e.what();
+    } catch (const std::exception& e) {
+        return std::string("error: ") + e.what();
+    }
+}
+
+/**
+ * @brief Describes what `Parser::ParseFile` makes of `text`.
+ */
+inline std::string DescribeParseFile(std::string_view text,
+                                     size_t spaces_per_tab) {
+    return Describe([&] {
+        Tokenizer tokenizer(text, spaces_per_tab);
+        Parser parser(tokenizer);
+        return parser.ParseFile();
+    });
+}
@@ -0,0 +1,61 @@
+// Tokenizes random sources, garbled ones included, on several threads in
+// chunks small enough for every source to be split, and checks that the
+// token buffer, literal values and error included, is the one a single
+// thread gives.
+//
+// Usage: tokenizer_test [seed] [sources]
+
+#include "testing.h"
+
+#include <parser/source.h>
+#include <parser/tokenizer.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+constexpr size_t kSpacesPerTab = 4;
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    unsigned seed = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 42;
+    size_t sources = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2000;
+    std::mt19937 rng(seed);
+
+    const size_t kThreads[] = {2, 3, 8};
+    const size_t kMinChunkSizes[] = {1, 16, 256};
+    size_t runs = 0;
+    size_t errors = 0;
+    size_t failures = 0;
+    for (size_t i = 0; i < sources; ++i) {
+        std::string text = GenerateSource(rng, 20);
+        // Garbled again, as single bytes rarely break the tokenizer.
+        if (GetChance(rng, 0.3)) {
+            Garble(rng, text);
+        }
+        Source source = Source::FromString(text);
+        TokenBuffer expected = Tokenizer(source, kSpacesPerTab).Tokenize();
+        errors += expected.GetError().has_value();
+        for (size_t threads : kThreads) {
+            for (size_t min_chunk_size : kMinChunkSizes) {
+                ++runs;
+                TokenBuffer got = Tokenizer(source, kSpacesPerTab)
+                                      .Tokenize(threads, min_chunk_size);
+                if (got != expected && ++failures <= 3) {
+                    std::printf(
+                        "Mismatch in source %zu on %zu threads in chunks of "
+                        "at least %zu bytes.\n--- text\n%s\n",
+                        i, threads, min_chunk_size, text.c_str());
+                }
+            }
+        }
+    }
+    std::printf(
+        "%zu of %zu parallel runs over %zu sources (%zu with errors) differ "
+        "from one thread.\n",
+        failures, runs, sources, errors);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}